@@ -0,0 +1 @@
+#include "../src/tcache.h"
@@ -0,0 +1 @@
+#include "../src/tlazyloader.h"
@@ -0,0 +1 @@
+#include "../src/tsqlasyncquery.h"
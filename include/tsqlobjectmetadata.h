@@ -0,0 +1 @@
+#include "../src/tsqlobjectmetadata.h"
@@ -0,0 +1 @@
+#include "../src/tsqlormappercursor.h"
@@ -0,0 +1 @@
+#include "../src/tsqlormapperfuture.h"
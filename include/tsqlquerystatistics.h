@@ -0,0 +1 @@
+#include "../src/tsqlquerystatistics.h"
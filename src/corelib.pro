@@ -77,6 +77,8 @@ HEADERS += tactionforkprocess.h
 SOURCES += tactionforkprocess.cpp
 HEADERS += thttpsocket.h
 SOURCES += thttpsocket.cpp
+HEADERS += thttpchunkeddevice.h
+SOURCES += thttpchunkeddevice.cpp
 HEADERS += tabstractcontroller.h
 SOURCES += tabstractcontroller.cpp
 HEADERS += tactioncontroller.h
@@ -91,14 +93,28 @@ HEADERS += tsqldatabasepool.h
 SOURCES += tsqldatabasepool.cpp
 HEADERS += tsqlobject.h
 SOURCES += tsqlobject.cpp
+HEADERS += tsqlobjectmetadata.h
+SOURCES += tsqlobjectmetadata.cpp
 HEADERS += tsqlormapperiterator.h
 SOURCES += tsqlormapperiterator.cpp
+HEADERS += tsqlormapperfuture.h
+SOURCES += tsqlormapperfuture.cpp
+HEADERS += tsqlormappercursor.h
+SOURCES += tsqlormappercursor.cpp
 HEADERS += tsqlquery.h
 SOURCES += tsqlquery.cpp
 HEADERS += tsqlqueryormapper.h
 SOURCES += tsqlqueryormapper.cpp
 HEADERS += tsqlqueryormapperiterator.h
 SOURCES += tsqlqueryormapperiterator.cpp
+HEADERS += tsqlstatementcache.h
+SOURCES += tsqlstatementcache.cpp
+HEADERS += tsqlresultcache.h
+SOURCES += tsqlresultcache.cpp
+HEADERS += tsqlquerystatistics.h
+SOURCES += tsqlquerystatistics.cpp
+HEADERS += tsqlasyncquery.h
+SOURCES += tsqlasyncquery.cpp
 HEADERS += tsqltransaction.h
 SOURCES += tsqltransaction.cpp
 HEADERS += tcriteria.h
@@ -197,6 +213,8 @@ HEADERS += tformvalidator.h
 SOURCES += tformvalidator.cpp
 HEADERS += taccessvalidator.h
 SOURCES += taccessvalidator.cpp
+HEADERS += tcache.h
+SOURCES += tcache.cpp
 
 HEADERS += \
            tfnamespace.h \
@@ -210,8 +228,8 @@ HEADERS += \
 #           tmailer.h \
 #           tmailerplugin.h \
            thttprequestheader.h \
-           thttpresponseheader.h
-#           tlazyloader.h
+           thttpresponseheader.h \
+           tlazyloader.h
 
 win32 {
   SOURCES += twebapplication_win.cpp
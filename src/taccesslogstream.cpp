@@ -7,19 +7,43 @@
 
 #include <QSystemSemaphore>
 #include <QFileInfo>
+#include <QThread>
+#include <QMutexLocker>
 #include <TWebApplication>
 #include <TSystemGlobal>
 #include "tfilelogger.h"
 #include "taccesslogstream.h"
 
+#define MAX_BUFFER_SIZE  (4 * 1024 * 1024)
+
 /*!
   \class TAccessLogStream
   \brief The TAccessLogStream class provides a stream for access log.
+
+  The logs are written to the file by a writer thread, so that the
+  threads which write logs do not wait for the file. The writer thread
+  writes all the pending logs at once; in prefork mode, it acquires the
+  semaphore of the file once for them. If the file cannot keep up and
+  the pending logs exceed 4 MB, the new logs are dropped and the number
+  of them is written to the file instead.
 */
 
 
+class TAccessLogWriter : public QThread
+{
+public:
+    TAccessLogWriter(TAccessLogStream *stream) : QThread(), logStream(stream) { }
+
+protected:
+    void run() { logStream->writeLoop(); }
+
+private:
+    TAccessLogStream *logStream;
+};
+
+
 TAccessLogStream::TAccessLogStream(const QString &fileName)
-    : logger(new TFileLogger), semaphore(0)
+    : logger(new TFileLogger), semaphore(0), writer(0), dropCount(0), stopped(false)
 {
     logger->setFileName(fileName);
     
@@ -28,25 +52,77 @@ TAccessLogStream::TAccessLogStream(const QString &fileName)
     } else {
         logger->open();
     }
+
+    writer = new TAccessLogWriter(this);
+    writer->start();
 }
 
 
 TAccessLogStream::~TAccessLogStream()
 {
+    {
+        QMutexLocker locker(&mutex);
+        stopped = true;
+        condition.wakeAll();
+    }
+    writer->wait();
+    delete writer;
+
     delete logger;
     if (semaphore)
         delete semaphore;
 }
 
-
+/*!
+  Queues the log \a log to be written by the writer thread. The log is
+  dropped if the pending logs exceed the limit.
+*/
 void TAccessLogStream::writeLog(const QByteArray &log)
+{
+    QMutexLocker locker(&mutex);
+    if (buffer.length() + log.length() > MAX_BUFFER_SIZE) {
+        ++dropCount;
+        return;
+    }
+    buffer += log;
+    condition.wakeOne();
+}
+
+/*!
+  Writes the queued logs until the stream is destroyed.
+*/
+void TAccessLogStream::writeLoop()
+{
+    for (;;) {
+        QByteArray data;
+        {
+            QMutexLocker locker(&mutex);
+            while (buffer.isEmpty() && !stopped) {
+                condition.wait(&mutex);
+            }
+            if (buffer.isEmpty()) {
+                break;  // stopped
+            }
+            data = buffer;
+            buffer.clear();
+            if (dropCount > 0) {
+                data += "(" + QByteArray::number(dropCount) + " logs dropped)\n";
+                dropCount = 0;
+            }
+        }
+        write(data);
+    }
+}
+
+
+void TAccessLogStream::write(const QByteArray &data)
 {
     if (semaphore) {
         semaphore->acquire();
         logger->open();
     }
     
-    logger->log(log);
+    logger->log(data);
     logger->flush();
     
     if (semaphore) {
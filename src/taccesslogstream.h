@@ -1,8 +1,13 @@
 #ifndef TACCESSLOGSTREAM_H
 #define TACCESSLOGSTREAM_H
 
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+
 class QSystemSemaphore;
 class TFileLogger;
+class TAccessLogWriter;
 
 
 class TAccessLogStream
@@ -13,9 +18,19 @@ public:
     void writeLog(const QByteArray &log);
 
 private:
+    void writeLoop();
+    void write(const QByteArray &data);
+
     TFileLogger *logger;
     QSystemSemaphore *semaphore;
-    
+    TAccessLogWriter *writer;
+    QByteArray buffer;
+    int dropCount;
+    bool stopped;
+    QMutex mutex;
+    QWaitCondition condition;
+
+    friend class TAccessLogWriter;
     TAccessLogStream(const TAccessLogStream &);
     TAccessLogStream &operator=(const TAccessLogStream &);
 };
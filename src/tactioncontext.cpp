@@ -17,9 +17,11 @@
 #include <TDispatcher>
 #include <TActionController>
 #include <TSqlDatabasePool>
+#include <TSqlResultCache>
 #include <TSessionStore>
 #include "tsystemglobal.h"
 #include "thttpsocket.h"
+#include "thttpchunkeddevice.h"
 #include "tsessionmanager.h"
 #include "turlroute.h"
 #include "taccesslog.h"
@@ -41,7 +43,8 @@
 
 
 TActionContext::TActionContext(int socket)
-    : sqlDatabases(Tf::app()->databaseSettingsCount() + 1), stopped(false), socketDesc(socket), httpSocket(0), currController(0)
+    : sqlDatabases(TSqlDatabasePool::instance()->databaseCount() + 1), sqlReadDatabases(TSqlDatabasePool::instance()->databaseCount()),
+      writtenDatabases(TSqlDatabasePool::instance()->databaseCount(), false), stopped(false), socketDesc(socket), httpSocket(0), currController(0)
 { }
 
 
@@ -66,17 +69,55 @@ TActionContext::~TActionContext()
 }
 
 
+/*!
+  Returns the database connection \a id for the current action. A
+  transaction is not begun until the first write statement, except in
+  read-only actions, where a read-only transaction is begun here.
+  \sa beginTransaction()
+*/
 QSqlDatabase &TActionContext::getDatabase(int id)
 {
     T_TRACEFUNC("id:%d", id);
 
-    if (id < 0 || id >= Tf::app()->databaseSettingsCount())
-        return sqlDatabases[Tf::app()->databaseSettingsCount()];  // invalid db
+    if (id < 0 || id >= writtenDatabases.count())
+        return sqlDatabases.last();  // invalid db
     
     QSqlDatabase &db = sqlDatabases[id];
     if (!db.isValid()) {
         db = TSqlDatabasePool::instance()->pop(id);
-        beginTransaction(db);
+        if (transactions.isReadOnly()) {
+            beginTransaction(db);
+        }
+    }
+    return db;
+}
+
+
+/*!
+  Returns a database connection \a id for reading. The connection is to
+  a replica of the database if any is configured in the database
+  settings, e.g. [product.replica1], and the current action has not
+  written to the database \a id yet; otherwise it is the connection
+  returned by getDatabase(), so that the action reads its own writes.
+  Reads from a replica run in autocommit mode.
+*/
+QSqlDatabase &TActionContext::getReadDatabase(int id)
+{
+    T_TRACEFUNC("id:%d", id);
+
+    if (id < 0 || id >= writtenDatabases.count())
+        return sqlDatabases.last();  // invalid db
+
+    if (writtenDatabases[id] || TSqlDatabasePool::instance()->replicaCount(id) == 0)
+        return getDatabase(id);
+
+    QSqlDatabase &db = sqlReadDatabases[id];
+    if (!db.isValid()) {
+        db = TSqlDatabasePool::instance()->popReplica(id);
+        if (!db.isValid()) {
+            // No replica available
+            return getDatabase(id);
+        }
     }
     return db;
 }
@@ -89,6 +130,16 @@ void TActionContext::releaseDatabases()
     for (int i = 0; i < sqlDatabases.count(); ++i) {
         TSqlDatabasePool::instance()->push(sqlDatabases[i]);
     }
+    for (int i = 0; i < sqlReadDatabases.count(); ++i) {
+        TSqlDatabasePool::instance()->push(sqlReadDatabases[i]);
+    }
+    writtenDatabases.fill(false);
+
+    // Tables written in autocommit mode
+    for (QStringListIterator it(writtenTables); it.hasNext(); ) {
+        TSqlResultCache::invalidate(it.next());
+    }
+    writtenTables.clear();
 }
 
 
@@ -190,87 +241,107 @@ void TActionContext::execute()
             currController->setActionName(rt.action);
             currController->setHttpRequest(httpRequest);
             
-            // Session
-            if (currController->sessionEnabled()) {
-                TSession session;
-                QByteArray sessionId = httpRequest.cookie(TSession::sessionName());
-                if (!sessionId.isEmpty()) {
-                    // Finds a session
-                    session = TSessionManager::instance().findSession(sessionId);
-                }
-                currController->setSession(session);
+            // Page cache
+            bool cached = (method == Tf::Get || method == Tf::Head) && currController->restorePageCache();
+            if (!cached) {
+                // Session
+                if (currController->sessionEnabled()) {
+                    TSession session;
+                    QByteArray sessionId = httpRequest.cookie(TSession::sessionName());
+                    if (!sessionId.isEmpty()) {
+                        // Finds a session
+                        session = TSessionManager::instance().findSession(sessionId);
+                    }
+                    currController->setSession(session);
                 
-                // Exports flash-variant
-                currController->exportAllFlashVariants();
-            }
+                    // Exports flash-variant
+                    currController->exportAllFlashVariants();
+                }
             
-            // Verify authenticity token
-            if (Tf::app()->appSettings().value(ENABLE_CSRF_PROTECTION_MODULE, true).toBool()
-                && currController->csrfProtectionEnabled() && !currController->exceptionActionsOfCsrfProtection().contains(rt.action)) {
+                // Verify authenticity token
+                if (Tf::app()->appSettings().value(ENABLE_CSRF_PROTECTION_MODULE, true).toBool()
+                    && currController->csrfProtectionEnabled() && !currController->exceptionActionsOfCsrfProtection().contains(rt.action)) {
 
-                if (method == Tf::Post || method == Tf::Put || method == Tf::Delete) {
-                    if (!currController->verifyRequest(httpRequest)) {
-                        throw SecurityException("Invalid authenticity token", __FILE__, __LINE__);
+                    if (method == Tf::Post || method == Tf::Put || method == Tf::Delete) {
+                        if (!currController->verifyRequest(httpRequest)) {
+                            throw SecurityException("Invalid authenticity token", __FILE__, __LINE__);
+                        }
                     }
                 }
-            }
 
-            if (currController->sessionEnabled()) {
-                if (currController->session().id().isEmpty() || Tf::app()->appSettings().value(AUTO_ID_REGENERATION).toBool()) {
-                    TSessionManager::instance().remove(currController->session().sessionId); // Removes the old session
-                    // Re-generate session ID
-                    currController->session().sessionId = TSessionManager::instance().generateId();
-                    tSystemDebug("Re-generate session ID: %s", currController->session().sessionId.data());
-                }                
-                // Sets CSRF protection informaion
-                TActionController::setCsrfProtectionInto(currController->session());
-            }
+                if (currController->sessionEnabled()) {
+                    if (currController->session().id().isEmpty() || Tf::app()->appSettings().value(AUTO_ID_REGENERATION).toBool()) {
+                        TSessionManager::instance().remove(currController->session().sessionId); // Removes the old session
+                        // Re-generate session ID
+                        currController->session().sessionId = TSessionManager::instance().generateId();
+                        tSystemDebug("Re-generate session ID: %s", currController->session().sessionId.data());
+                    }                
+                    // Sets CSRF protection informaion
+                    TActionController::setCsrfProtectionInto(currController->session());
+                }
 
-            // Database Transaction
-            transactions.setEnabled(currController->transactionEnabled());
+                // Database Transaction
+                transactions.setEnabled(currController->transactionEnabled());
+                transactions.setReadOnly(currController->readOnlyActions().contains(rt.action));
             
-            // Do filters
-            if (currController->preFilter()) {
+                // Do filters
+                if (currController->preFilter()) {
                 
-                // Dispathes
-                bool dispatched = ctlrDispatcher.invoke(rt.action, rt.params);
-                if (dispatched) {
-                    autoRemoveFiles << currController->autoRemoveFiles;  // Adds auto-remove files
+                    // Dispathes
+                    bool dispatched = ctlrDispatcher.invoke(rt.action, rt.params);
+                    if (dispatched) {
+                        autoRemoveFiles << currController->autoRemoveFiles;  // Adds auto-remove files
                     
-                    // Post fileter
-                    currController->postFilter();
+                        // Post fileter
+                        currController->postFilter();
                     
-                    if (currController->rollbackRequested()) {
-                        rollbackTransactions();
-                    } else {
-                        // Commits a transaction to the database
-                        commitTransactions();
-                    }
+                        if (currController->rollbackRequested()) {
+                            rollbackTransactions();
+                        } else {
+                            // Commits a transaction to the database
+                            commitTransactions();
+                        }
+                        // Statements after here run in autocommit mode
+                        transactions.setEnabled(false);
                     
-                    // Session store
-                    if (currController->sessionEnabled()) {
-                        bool stored = TSessionManager::instance().store(currController->session());
-                        if (stored) {
-                            QDateTime expire;
-                            if (TSessionManager::sessionLifeTime() > 0) {
-                                expire = QDateTime::currentDateTime().addSecs(TSessionManager::sessionLifeTime());
-                            }
+                        // Page cache, for the methods answered from it
+                        if (method == Tf::Get || method == Tf::Head) {
+                            currController->storePageCache();
+                        }
+
+                        // Session store
+                        if (currController->sessionEnabled()) {
+                            bool stored = TSessionManager::instance().store(currController->session());
+                            if (stored) {
+                                QDateTime expire;
+                                if (TSessionManager::sessionLifeTime() > 0) {
+                                    expire = QDateTime::currentDateTime().addSecs(TSessionManager::sessionLifeTime());
+                                }
                             
-                            // Sets the path in the session cookie
-                            QString cookiePath = Tf::app()->appSettings().value(SESSION_COOKIE_PATH).toString();
-                            currController->addCookie(TSession::sessionName(), currController->session().id(), expire, cookiePath);
+                                // Sets the path in the session cookie
+                                QString cookiePath = Tf::app()->appSettings().value(SESSION_COOKIE_PATH).toString();
+                                currController->addCookie(TSession::sessionName(), currController->session().id(), expire, cookiePath);
+                            }
                         }
                     }
                 }
-            }
             
-            // Sets the default status code of HTTP response
-            accessLog.statusCode = (!currController->response.isBodyNull()) ? currController->statusCode() : Tf::InternalServerError;
-            currController->response.header().setStatusLine(accessLog.statusCode, THttpUtility::getResponseReasonPhrase(accessLog.statusCode));
+            }
+
+            if (currController->isStreamingPending()) {
+                // Streams the view
+                accessLog.statusCode = currController->statusCode();
+                currController->response.header().setStatusLine(accessLog.statusCode, THttpUtility::getResponseReasonPhrase(accessLog.statusCode));
+                accessLog.responseBytes = writeStreamingResponse(currController->response.header(), hdr);
+            } else {
+                // Sets the default status code of HTTP response
+                accessLog.statusCode = (!currController->response.isBodyNull()) ? currController->statusCode() : Tf::InternalServerError;
+                currController->response.header().setStatusLine(accessLog.statusCode, THttpUtility::getResponseReasonPhrase(accessLog.statusCode));
 
-            // Writes a response and access log
-            accessLog.responseBytes = writeResponse(currController->response.header(), currController->response.bodyIODevice(),
-                                                    currController->response.bodyLength());
+                // Writes a response and access log
+                accessLog.responseBytes = writeResponse(currController->response.header(), currController->response.bodyIODevice(),
+                                                        currController->response.bodyLength());
+            }
             
             httpSocket->disconnectFromHost();
 
@@ -396,23 +467,99 @@ qint64 TActionContext::writeResponse(THttpResponseHeader &header, QIODevice *bod
 }
 
 
+qint64 TActionContext::writeStreamingResponse(THttpResponseHeader &header, const THttpRequestHeader &requestHeader)
+{
+    T_TRACEFUNC("");
+    qint64 res = -1;
+    if (httpSocket) {
+        // The chunked transfer coding is available since HTTP/1.1
+        bool chunked = (requestHeader.majorVersion() > 1 || (requestHeader.majorVersion() == 1 && requestHeader.minorVersion() >= 1));
+
+        header.removeAllRawHeaders("Content-Length");
+        if (chunked) {
+            header.setRawHeader("Transfer-Encoding", "chunked");
+        }
+        header.setRawHeader("Server", "TreeFrog server");
+        header.setRawHeader("Date", QLocale::c().toString(QDateTime::currentDateTime().toUTC(),
+                                                          QLatin1String("ddd, dd MMM yyyy hh:mm:ss 'GMT'")).toLatin1());
+        header.setRawHeader("Connection", "close");
+        res = httpSocket->write(static_cast<THttpHeader*>(&header), 0);
+        if (res < 0) {
+            return res;
+        }
+
+        THttpChunkedDevice device(httpSocket, chunked);
+        device.open(QIODevice::WriteOnly);
+        currController->renderStreamingView(&device);
+        device.close();
+        httpSocket->waitForBytesWritten();  // socket flush
+        res += device.bytesSent();
+    }
+    return res;
+}
+
+
 void TActionContext::emitError(int )
 { }
 
 
+/*!
+  Begins a transaction on the database connection \a database, if not
+  begun yet. This function is called before a write statement; the
+  following reads of the action go to the same database.
+*/
 bool TActionContext::beginTransaction(QSqlDatabase &database)
 {
+    bool ok;
+    int id = database.connectionName().left(2).toInt(&ok);
+    if (ok && id >= 0 && id < writtenDatabases.count()) {
+        writtenDatabases[id] = true;
+    }
+
     bool ret = true;
-    if (database.driver()->hasFeature(QSqlDriver::Transactions)) {
+    if (database.isValid() && database.driver()->hasFeature(QSqlDriver::Transactions)
+        && !transactions.isActive(database)) {
         ret = transactions.begin(database);
     }
     return ret;
 }
 
 
+/*!
+  Returns true if the current action has written to the database \a id;
+  otherwise returns false. The rows read from the database after a write
+  may be uncommitted, so they are not put in the result cache.
+  \sa TSqlResultCache
+*/
+bool TActionContext::isDatabaseWritten(int id) const
+{
+    return id >= 0 && id < writtenDatabases.count() && writtenDatabases[id];
+}
+
+
+/*!
+  Invalidates the results cached for the table \a table before a write
+  to it. The results are invalidated again when the transaction is
+  committed, since the other actions may cache the rows read before the
+  commit in the meantime.
+*/
+void TActionContext::invalidateResultCache(const QString &table)
+{
+    TSqlResultCache::invalidate(table);
+    if (!writtenTables.contains(table)) {
+        writtenTables << table;
+    }
+}
+
+
 void TActionContext::commitTransactions()
 {
     transactions.commit();
+
+    for (QStringListIterator it(writtenTables); it.hasNext(); ) {
+        TSqlResultCache::invalidate(it.next());
+    }
+    writtenTables.clear();
 }
 
 
@@ -9,6 +9,7 @@
 
 class QHostAddress;
 class THttpResponseHeader;
+class THttpRequestHeader;
 class THttpSocket;
 class THttpResponse;
 class TApplicationServer;
@@ -23,6 +24,10 @@ public:
     virtual ~TActionContext();
 
     QSqlDatabase &getDatabase(int id);
+    QSqlDatabase &getReadDatabase(int id);
+    bool beginTransaction(QSqlDatabase &database);
+    bool isDatabaseWritten(int id) const;
+    void invalidateResultCache(const QString &table);
     void releaseDatabases();
     TTemporaryFile &createTemporaryFile();
     void stop() { stopped = true; }
@@ -33,7 +38,6 @@ public:
 protected:
     void execute();
     virtual void emitError(int socketError);
-    bool beginTransaction(QSqlDatabase &database);
     void commitTransactions();
     void rollbackTransactions();
 
@@ -41,8 +45,12 @@ protected:
     qint64 writeResponse(int statusCode, THttpResponseHeader &header);
     qint64 writeResponse(int statusCode, THttpResponseHeader &header, const QByteArray &contentType, QIODevice *body, qint64 length);
     qint64 writeResponse(THttpResponseHeader &header, QIODevice *body, qint64 length);
+    qint64 writeStreamingResponse(THttpResponseHeader &header, const THttpRequestHeader &requestHeader);
 
     QVector<QSqlDatabase> sqlDatabases;
+    QVector<QSqlDatabase> sqlReadDatabases;
+    QVector<bool> writtenDatabases;
+    QStringList writtenTables;
     TSqlTransaction transactions;
     volatile bool stopped;
 
@@ -13,6 +13,8 @@
 #include <QTextCodec>
 #include <QCryptographicHash>
 #include <QMutexLocker>
+#include <QBuffer>
+#include <QDataStream>
 #include <TActionController>
 #include <TWebApplication>
 #include <TDispatcher>
@@ -21,6 +23,8 @@
 #include <TAbstractUser>
 #include <TActionContext>
 #include <TFormValidator>
+#include <THttpUtility>
+#include <TCache>
 #include "tsessionmanager.h"
 #include "ttextview.h"
 
@@ -28,6 +32,9 @@
 #define FLASH_VARS_SESSION_KEY  "_flashVariants"
 #define LOGIN_USER_NAME_KEY     "_loginUserName"
 #define CSRF_PROTECTION_KEY     "Session.CsrfProtectionKey"
+#define PAGE_CACHE_MAX_ENTRIES  "PageCache.MaxEntries"
+
+Q_GLOBAL_STATIC_WITH_ARGS(TCache, pageCache, (Tf::app()->appSettings().value(PAGE_CACHE_MAX_ENTRIES, 1000).toInt()))
 
 /*!
   \class TActionController
@@ -52,6 +59,7 @@ TActionController::TActionController()
       statCode(200),
       rendered(false),
       layoutEnable(true),
+      streamingEnable(false),
       rollback(false)
 {
     // Default content type
@@ -314,8 +322,13 @@ bool TActionController::render(const QString &action, const QString &layout)
     rendered = true;
 
     // Creates view-object and displays it
-    TDispatcher<TActionView> viewDispatcher(viewClassName(action));
+    QString viewName = viewClassName(action);
     setLayout(layout);
+    if (deferStreaming(viewName)) {
+        return true;
+    }
+
+    TDispatcher<TActionView> viewDispatcher(viewName);
     response.setBody(renderView(viewDispatcher.object()));
     return !response.isBodyNull();
 }
@@ -344,8 +357,13 @@ bool TActionController::renderTemplate(const QString &templateName, const QStrin
         tError("Invalid patameter: %s", qPrintable(templateName));
         return false;
     }
-    TDispatcher<TActionView> viewDispatcher(viewClassName(names[0], names[1]));
+    QString viewName = viewClassName(names[0], names[1]);
     setLayout(layout);
+    if (deferStreaming(viewName)) {
+        return true;
+    }
+
+    TDispatcher<TActionView> viewDispatcher(viewName);
     response.setBody(renderView(viewDispatcher.object()));
     return (!response.isBodyNull());
 }
@@ -385,6 +403,15 @@ bool TActionController::renderText(const QString &text, bool layoutEnable, const
   部分テンプレート \a templateName に変数 \a vars を設定した描画データを返す
 */
 QString TActionController::getRenderingData(const QString &templateName, const QVariantHash &vars)
+{
+    return QString::fromUtf8(renderPartialView(templateName, vars));
+}
+
+/*!
+  Returns the UTF-8 rendering data of the partial template given by
+  \a templateName.
+*/
+QByteArray TActionController::renderPartialView(const QString &templateName, const QVariantHash &vars)
 {
     T_TRACEFUNC("templateName: %s", qPrintable(templateName));
 
@@ -392,13 +419,13 @@ QString TActionController::getRenderingData(const QString &templateName, const Q
     QStringList names = templateName.split("/");
     if (names.count() != 2) {
         tError("Invalid patameter: %s", qPrintable(templateName));
-        return QString();
+        return QByteArray();
     }
 
     TDispatcher<TActionView> viewDispatcher(viewClassName(names[0], names[1]));
     TActionView *view = viewDispatcher.object();
     if (!view) {
-        return QString();
+        return QByteArray();
     }
 
     QVariantHash hash = allVariants();
@@ -409,18 +436,75 @@ QString TActionController::getRenderingData(const QString &templateName, const Q
 
     view->setController(this);
     view->setVariantHash(hash);
-    return view->toString();  
+    return view->toByteArray();
+}
+
+
+/*
+  Converts the UTF-8 data rendered by views into the encoding of HTTP
+  output. No conversion is needed if the encoding is UTF-8.
+*/
+static bool isHttpOutputUtf8()
+{
+    QTextCodec *codec = Tf::app()->codecForHttpOutput();
+    return (!codec || codec->mibEnum() == 106);  // UTF-8
+}
+
+
+static QByteArray toHttpOutputEncoding(const QByteArray &data)
+{
+    if (isHttpOutputUtf8()) {
+        return data;
+    }
+    return Tf::app()->codecForHttpOutput()->fromUnicode(QString::fromUtf8(data.constData(), data.length()));
+}
+
+
+/*!
+  Defers rendering of the view \a viewName to stream the response if
+  the streaming is enabled. Returns true if deferred; otherwise returns
+  false. The response is streamed only if the view exists and the
+  encoding of HTTP output is UTF-8.
+*/
+bool TActionController::deferStreaming(const QString &viewName)
+{
+    if (!streamingEnable || !isHttpOutputUtf8())
+        return false;
+
+    if (QMetaType::type(viewName.toLatin1().constData()) == 0) {
+        tSystemDebug("No such view for streaming: %s", qPrintable(viewName));
+        return false;
+    }
+    streamingView = viewName;
+    return true;
+}
+
+
+/*!
+  Renders the view deferred by render() or renderTemplate() and writes
+  it to the \a device as it is generated. Internal use only.
+*/
+void TActionController::renderStreamingView(QIODevice *device)
+{
+    T_TRACEFUNC("view: %s", qPrintable(streamingView));
+
+    TDispatcher<TActionView> viewDispatcher(streamingView);
+    QByteArray rest = renderView(viewDispatcher.object(), device);
+    device->write(rest);
+    streamingView.clear();
 }
 
 
 /*!
   \~english
-  Renders the \a view view.
+  Renders the \a view view. If \a device is not null, the rendered
+  data is written to the device while rendering, and the data not
+  written yet is returned.
 
   \~japanese
   ビューを描画する
 */
-QByteArray TActionController::renderView(TActionView *view)
+QByteArray TActionController::renderView(TActionView *view, QIODevice *device)
 {
     T_TRACEFUNC("view: %p  layout: %s", view, qPrintable(layout()));
 
@@ -430,11 +514,12 @@ QByteArray TActionController::renderView(TActionView *view)
     }
     view->setController(this);
     view->setVariantHash(allVariants());
+    view->setOutputDevice(device);
 
     if (!layoutEnabled()) {
         // Renders without layout
         tSystemDebug("Renders without layout");
-        return Tf::app()->codecForHttpOutput()->fromUnicode(view->toString());
+        return toHttpOutputEncoding(view->toByteArray());
     }
   
     // Displays with layout
@@ -452,7 +537,7 @@ QByteArray TActionController::renderView(TActionView *view)
             layoutView = defLayoutDispatcher.object();
             if (!layoutView) {
                 tSystemDebug("Not found default layout. Renders without layout.");
-                return Tf::app()->codecForHttpOutput()->fromUnicode(view->toString());
+                return toHttpOutputEncoding(view->toByteArray());
             }
         }
     }
@@ -461,7 +546,124 @@ QByteArray TActionController::renderView(TActionView *view)
     layoutView->setVariantHash(allVariants());
     layoutView->setController(this);
     layoutView->setSubActionView(view);
-    return Tf::app()->codecForHttpOutput()->fromUnicode(layoutView->toString());
+    layoutView->setOutputDevice(device);
+    return toHttpOutputEncoding(layoutView->toByteArray());
+}
+
+/*!
+  Returns the key of the page cache for the current request. The key
+  consists of the controller name, the action name, the request method,
+  the request path including the query string and the values of the
+  headers returned by pageCacheVaryHeaders(). The method keeps the
+  responses of HEAD requests, whose bodies may be empty, apart from
+  those of GET requests.
+*/
+QByteArray TActionController::pageCacheKey() const
+{
+    QByteArray key = name().toLower().toUtf8();
+    key += '#';
+    key += activeAction().toUtf8();
+    key += '\n';
+    key += request.header().method().toUpper();
+    key += ' ';
+    key += request.header().path();
+
+    QList<QByteArray> vary = pageCacheVaryHeaders(activeAction());
+    for (QListIterator<QByteArray> i(vary); i.hasNext(); ) {
+        const QByteArray &field = i.next();
+        key += '\n';
+        key += field.toLower();
+        key += ':';
+        key += request.header().rawHeader(field);
+    }
+    return key;
+}
+
+/*!
+  Sets the response cached for the current request into this
+  controller. Returns true if a live entry of the page cache was found;
+  otherwise returns false.
+*/
+bool TActionController::restorePageCache()
+{
+    T_TRACEFUNC("");
+
+    if (pageCacheLifeTime(activeAction()) <= 0)
+        return false;
+
+    QByteArray data = pageCache()->value(pageCacheKey());
+    if (data.isEmpty())
+        return false;
+
+    QByteArray header, body;
+    QDataStream ds(data);
+    ds >> header >> body;
+    if (ds.status() != QDataStream::Ok)
+        return false;
+
+    response.header() = THttpResponseHeader(header);
+    response.setBody(body);
+    statCode = response.header().statusCode();
+    rendered = true;
+    tSystemDebug("Page cache hit: %s#%s", qPrintable(name()), qPrintable(activeAction()));
+    return true;
+}
+
+/*!
+  Stores the response of the current request into the page cache if
+  caching is enabled for the active action. Only successful responses
+  held in memory are stored; streamed responses and responses which set
+  cookies are not stored.
+*/
+void TActionController::storePageCache()
+{
+    T_TRACEFUNC("");
+
+    int lifeTime = pageCacheLifeTime(activeAction());
+    if (lifeTime <= 0 || statCode != Tf::OK || rollback || isStreamingPending())
+        return;
+
+    if (response.header().hasRawHeader("Set-Cookie"))
+        return;
+
+    QBuffer *buffer = qobject_cast<QBuffer *>(response.bodyIODevice());
+    if (!buffer)
+        return;
+
+    THttpResponseHeader header = response.header();
+    header.setStatusLine(statCode, THttpUtility::getResponseReasonPhrase(statCode));
+    header.removeAllRawHeaders("Content-Length");
+    header.removeAllRawHeaders("Date");
+
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds << header.toByteArray() << buffer->data();
+    pageCache()->insert(pageCacheKey(), data, lifeTime);
+}
+
+/*!
+  Removes the cached pages of the action \a action of the controller
+  \a controller from the page cache. If \a action is empty, removes all
+  the cached pages of the controller. The name of the controller is
+  given without the 'Controller' suffix, as returned by name().
+*/
+void TActionController::expirePageCache(const QString &controller, const QString &action)
+{
+    QByteArray prefix = controller.toLower().toUtf8();
+    prefix += '#';
+    if (!action.isEmpty()) {
+        prefix += action.toUtf8();
+        prefix += '\n';
+    }
+    pageCache()->removeByPrefix(prefix);
+}
+
+/*!
+  Removes all the cached pages from the page cache.
+*/
+void TActionController::clearPageCache()
+{
+    pageCache()->clear();
 }
 
 /*!
@@ -804,6 +1006,38 @@ void TActionController::setFlashValidationErrors(const TFormValidator &v, const
   returns \a true.
 */
 
+/*!
+  \fn virtual QStringList TActionController::readOnlyActions() const;
+
+  Must be overridden by subclasses to return a string list of actions
+  which only read the database. Such an action runs in a read-only
+  transaction if the database supports it, otherwise in autocommit
+  mode. For the other actions, a transaction is begun at the first
+  write statement.
+  \sa transactionEnabled()
+*/
+
+/*!
+  \fn virtual int TActionController::pageCacheLifeTime(const QString &action) const;
+
+  Must be overridden by subclasses to cache the responses of the action
+  \a action. The function must return the number of seconds to keep
+  a response in the page cache; while the response is cached, the same
+  requests are answered without dispatching the action. A cached
+  response is shared by all clients, so the action must not depend on
+  the session. This function returns 0, which disables the page cache.
+  \sa pageCacheVaryHeaders(), expirePageCache()
+*/
+
+/*!
+  \fn virtual QList<QByteArray> TActionController::pageCacheVaryHeaders(const QString &action) const;
+
+  Must be overridden by subclasses to return the names of the request
+  headers, such as 'Accept-Language', whose values vary the cached
+  responses of the action \a action.
+  \sa pageCacheLifeTime()
+*/
+
 /*!
   \fn void TActionController::setLayoutEnabled(bool enable);
 
@@ -822,6 +1056,28 @@ void TActionController::setFlashValidationErrors(const TFormValidator &v, const
   \sa layoutEnabled()
 */
 
+/*!
+  \fn void TActionController::setStreamingEnabled(bool enable);
+
+  Enables streaming of the response if \a enable is true, otherwise
+  disables it. When the streaming is enabled, render() and
+  renderTemplate() defer rendering until the action and the filters
+  finish; the view is then written to the client as it is generated,
+  using the chunked transfer coding, with no Content-Length header.
+  A layout sends its head before the content is rendered. Response
+  headers, cookies and the session must be set before the action
+  returns. By default the streaming is disabled.
+  \sa streamingEnabled()
+*/
+
+/*!
+  \fn bool TActionController::streamingEnabled() const;
+
+  Returns true if streaming of the response is enabled; otherwise
+  returns false.
+  \sa setStreamingEnabled()
+*/
+
 /*!
   \fn QString TActionController::layout() const
 
@@ -36,6 +36,9 @@ public:
     virtual bool csrfProtectionEnabled() const { return true; }
     virtual QStringList exceptionActionsOfCsrfProtection() const { return QStringList(); }
     virtual bool transactionEnabled() const { return true; }
+    virtual QStringList readOnlyActions() const { return QStringList(); }
+    virtual int pageCacheLifeTime(const QString &) const { return 0; }
+    virtual QList<QByteArray> pageCacheVaryHeaders(const QString &) const { return QList<QByteArray>(); }
     QByteArray authenticityToken() const;
     QString flash(const QString &name) const;
     QHostAddress clientAddress() const;
@@ -43,6 +46,8 @@ public:
 
     static void setCsrfProtectionInto(TSession &session);
     static QStringList availableControllers();
+    static void expirePageCache(const QString &controller, const QString &action = QString());
+    static void clearPageCache();
 
 protected:
     virtual bool preFilter() { return true; }
@@ -52,6 +57,8 @@ protected:
     bool layoutEnabled() const;
     void setLayout(const QString &layout);
     QString layout() const;
+    void setStreamingEnabled(bool enable);
+    bool streamingEnabled() const;
     void setStatusCode(int code);
     int statusCode() const { return statCode; }
     void setFlash(const QString &name, const QVariant &value);
@@ -85,10 +92,17 @@ private:
     void setActionName(const QString &name);
     void setHttpRequest(const THttpRequest &httpRequest);
     bool verifyRequest(const THttpRequest &request) const;
-    QByteArray renderView(TActionView *view);
+    QByteArray renderView(TActionView *view, QIODevice *device = 0);
+    bool deferStreaming(const QString &viewName);
+    bool isStreamingPending() const { return !streamingView.isEmpty(); }
+    void renderStreamingView(QIODevice *device);
+    QByteArray renderPartialView(const QString &templateName, const QVariantHash &vars);
     void exportAllFlashVariants();
     const TActionController *controller() const { return this; }
     bool rollbackRequested() const { return rollback; }
+    QByteArray pageCacheKey() const;
+    bool restorePageCache();
+    void storePageCache();
     static QString layoutClassName(const QString &layout);
     static QString partialViewClassName(const QString &partial);
 
@@ -98,6 +112,8 @@ private:
     bool rendered;
     bool layoutEnable;
     QString layoutName;
+    bool streamingEnable;
+    QString streamingView;
     THttpRequest request;
     THttpResponse response;
     QVariantHash flashVars;
@@ -107,6 +123,7 @@ private:
     QStringList autoRemoveFiles;
 
     friend class TActionContext;
+    friend class TActionView;
     friend class TSessionCookieStore;
     friend class TDirectView;
     Q_DISABLE_COPY(TActionController)
@@ -153,6 +170,16 @@ inline QString TActionController::layout() const
     return layoutName;
 }
 
+inline void TActionController::setStreamingEnabled(bool enable)
+{
+    streamingEnable = enable;
+}
+
+inline bool TActionController::streamingEnabled() const
+{
+    return streamingEnable;
+}
+
 inline void TActionController::setStatusCode(int code)
 {
     statCode = code;
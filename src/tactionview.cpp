@@ -8,6 +8,13 @@
 #include <TActionView>
 #include <THttpUtility>
 #include <THtmlAttribute>
+#include <TWebApplication>
+#include <TCache>
+#include "tsystemglobal.h"
+
+#define FRAGMENT_CACHE_MAX_ENTRIES  "FragmentCache.MaxEntries"
+
+Q_GLOBAL_STATIC_WITH_ARGS(TCache, fragmentCache, (Tf::app()->appSettings().value(FRAGMENT_CACHE_MAX_ENTRIES, 1000).toInt()))
 
 /*!
   \class TActionView
@@ -20,27 +27,73 @@
   Constructor.
 */
 TActionView::TActionView()
-    : QObject(), TViewHelper(), TPrototypeAjaxHelper(), actionController(0), subView(0)
+    : QObject(), TViewHelper(), TPrototypeAjaxHelper(), actionController(0), subView(0), outputDevice(0)
 { }
 
+/*!
+  \fn virtual QString TActionView::toString() = 0;
+  Returns the rendered content of the view as a string. Subclasses
+  must reimplement this function.
+*/
+
+/*!
+  Returns the rendered content of the view as UTF-8 data. The default
+  implementation encodes the string returned by toString(). The views
+  generated by tmake reimplement this function to append UTF-8 data to
+  the buffer directly.
+*/
+QByteArray TActionView::toByteArray()
+{
+    return toString().toUtf8();
+}
+
 /*!
   Returns a content processed by a action.
+  \sa yieldBytes()
 */
 QString TActionView::yield() const
 {
-    return (subView) ? subView->toString() : QString();
+    return QString::fromUtf8(yieldBytes());
+}
+
+/*!
+  Returns a content processed by a action as UTF-8 data. Layouts output
+  it without conversion; tmake generates this call for
+  <%== yield() %>.
+*/
+QByteArray TActionView::yieldBytes() const
+{
+    if (!subView)
+        return QByteArray();
+
+    if (outputDevice) {
+        // Sends the head of the layout before the content is rendered
+        const_cast<TActionView *>(this)->flushResponse();
+    }
+    return subView->toByteArray();
 }
 
 /*!
   Render the partial template given by \a templateName without layout.
+  \sa renderPartialBytes()
 */
 QString TActionView::renderPartial(const QString &templateName, const QVariantHash &vars) const
+{
+    return QString::fromUtf8(renderPartialBytes(templateName, vars));
+}
+
+/*!
+  Render the partial template given by \a templateName without layout,
+  and returns the UTF-8 data; tmake generates this call for
+  <%== renderPartial(...) %>.
+*/
+QByteArray TActionView::renderPartialBytes(const QString &templateName, const QVariantHash &vars) const
 {
     QString temp = templateName;
     if (!temp.contains('/')) {
         temp = QLatin1String("partial/") + temp;
     }
-    return (actionController) ? actionController->getRenderingData(temp, vars) : QString(); 
+    return (actionController) ? actionController->renderPartialView(temp, vars) : QByteArray();
 }
 
 /*!
@@ -57,7 +110,8 @@ QString TActionView::authenticityToken() const
 */
 QString TActionView::echo(const THtmlAttribute &attr)
 {
-    responsebody += attr.toString().trimmed();
+    responsebody += attr.toString().trimmed().toUtf8();
+    flushIfFull();
     return QString();
 }
 
@@ -70,6 +124,104 @@ QString TActionView::eh(const THtmlAttribute &attr)
     return echo(THttpUtility::htmlEscape(attr.toString().trimmed()));
 }
 
+/*!
+  Starts the fragment of a view template cached with the key \a key.
+  If the cache holds a live fragment for the key, outputs the fragment
+  and returns false, so that the fragment is not rendered again;
+  otherwise returns true. The rendered fragment is stored for
+  \a lifeTime seconds when endFragmentCache() is called. If \a lifeTime
+  is 0, the fragment is stored until it is evicted or expired.
+
+  The block <% cache("key", lifeTime) { %> ... <% } %> in a template
+  is converted into calls of these functions.
+  \sa endFragmentCache(), expireFragmentCache()
+*/
+bool TActionView::beginFragmentCache(const QString &key, int lifeTime)
+{
+    FragmentCacheEntry entry;
+    entry.key = key;
+    entry.lifeTime = lifeTime;
+
+    QByteArray fragment = fragmentCache()->value(key.toUtf8());
+    if (!fragment.isEmpty()) {
+        responsebody += fragment;
+        entry.position = -1;
+        fragmentCaches << entry;
+        return false;
+    }
+
+    entry.position = responsebody.length();
+    fragmentCaches << entry;
+    return true;
+}
+
+/*!
+  Ends the fragment started by beginFragmentCache() and stores it
+  into the fragment cache if it was rendered.
+*/
+void TActionView::endFragmentCache()
+{
+    if (fragmentCaches.isEmpty()) {
+        tSystemWarn("Unbalanced fragment cache block");
+        return;
+    }
+
+    FragmentCacheEntry entry = fragmentCaches.takeLast();
+    if (entry.position >= 0) {
+        fragmentCache()->insert(entry.key.toUtf8(), responsebody.mid(entry.position), entry.lifeTime);
+    }
+}
+
+/*!
+  Writes the rendered data to the client and empties the buffer if the
+  response is being streamed; otherwise does nothing. The data is not
+  written while a fragment cache block is being rendered.
+  \sa TActionController::setStreamingEnabled()
+*/
+void TActionView::flushResponse()
+{
+    if (outputDevice && fragmentCaches.isEmpty() && !responsebody.isEmpty()) {
+        outputDevice->write(responsebody);
+        responsebody.truncate(0);
+    }
+}
+
+/*!
+  Updates the moving average \a average of the output size with the
+  size of the data rendered. Views generated by tmake call this
+  function at the end of rendering and reserve the average size for
+  the buffer the next time. Streamed output is not counted because it
+  is not kept in the buffer. The average is shared by the threads
+  without a lock; a lost update only makes it slightly less accurate.
+  \sa averageOutputSize()
+*/
+void TActionView::updateAverageOutputSize(QAtomicInt &average) const
+{
+    if (outputDevice)
+        return;
+
+    int size = responsebody.size();
+    int avg = average.fetchAndAddRelaxed(0);
+    // Exponential moving average with a smoothing factor of 1/8
+    average.fetchAndStoreRelaxed((avg > 0) ? avg + (size - avg) / 8 : size);
+}
+
+/*!
+  Removes the fragment with the key \a key from the fragment cache.
+*/
+void TActionView::expireFragmentCache(const QString &key)
+{
+    fragmentCache()->remove(key.toUtf8());
+}
+
+/*!
+  Removes all the fragments from the fragment cache.
+*/
+void TActionView::clearFragmentCache()
+{
+    fragmentCache()->clear();
+}
+
 
 /*!
   \fn QString TActionView::echo	(const QString &str)
@@ -78,12 +230,19 @@ QString TActionView::eh(const THtmlAttribute &attr)
 
 /*!
   \fn QString TActionView::echo(const char *str)
-  Outputs the string \a str to a view template.
+  Outputs the UTF-8 string \a str to a view template.
+*/
+
+/*!
+  \fn QString TActionView::echo(const char *str, int length)
+  Outputs the first \a length bytes of the UTF-8 string \a str to
+  a view template. The views generated by tmake output the literal
+  text of templates by this function.
 */
 
 /*!
   \fn QString TActionView::echo(const QByteArray &str)
-  Outputs the array \a str to a view template.
+  Outputs the UTF-8 array \a str to a view template.
 */
 
 /*!
@@ -132,6 +291,13 @@ QString TActionView::eh(const THtmlAttribute &attr)
   to a view template.
 */
 
+/*!
+  \fn virtual int TActionView::averageOutputSize() const
+  Returns the moving average of the size in bytes of the data rendered
+  by the view. Views generated by tmake reimplement this function; this
+  function returns 0.
+*/
+
 /*!
   \fn bool TActionView::hasVariant(const QString &name) const
   Returns true if the QVariantHash variable for a view contains 
@@ -143,12 +309,6 @@ QString TActionView::eh(const THtmlAttribute &attr)
   Returns the requested HTTP message.
 */
 
-/*!
-  \fn virtual QString TActionView::toString()
-  This function is reimplemented in subclasses to return a
-  string to render a view.
-*/
-
 /*!
   \fn QVariant TActionView::variant(const QString &name) const
   Returns the value associated with the \a name in the QVariantHash
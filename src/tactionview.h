@@ -5,6 +5,7 @@
 #include <QHash>
 #include <QTextStream>
 #include <QVariant>
+#include <QAtomicInt>
 #include <TGlobal>
 #include <TActionController>
 #include <TActionHelper>
@@ -20,17 +21,25 @@ public:
     virtual ~TActionView() { }
 
     virtual QString toString() = 0;
+    virtual QByteArray toByteArray();
     QString yield() const;
+    QByteArray yieldBytes() const;
     QString renderPartial(const QString &templateName, const QVariantHash &vars = QVariantHash()) const;
+    QByteArray renderPartialBytes(const QString &templateName, const QVariantHash &vars = QVariantHash()) const;
     QString authenticityToken() const;
     QVariant variant(const QString &name) const;
     bool hasVariant(const QString &name) const;
     const TActionController *controller() const;
     const THttpRequest &httpRequest() const;
+    virtual int averageOutputSize() const { return 0; }
+
+    static void expireFragmentCache(const QString &key);
+    static void clearFragmentCache();
 
 protected:
     QString echo(const QString &str);
     QString echo(const char *str);
+    QString echo(const char *str, int length);
     QString echo(const QByteArray &str);
     QString echo(int n, int base = 10);
     QString echo(double d, char format = 'g', int precision = 6);
@@ -43,7 +52,11 @@ protected:
     QString eh(double d, char format = 'g', int precision = 6);
     QString eh(const THtmlAttribute &attr);
     QString eh(const QVariant &var);
-    QString responsebody;
+    bool beginFragmentCache(const QString &key, int lifeTime = 0);
+    void endFragmentCache();
+    void flushResponse();
+    void updateAverageOutputSize(QAtomicInt &average) const;
+    QByteArray responsebody;
 
 private:
     Q_DISABLE_COPY(TActionView)
@@ -51,11 +64,22 @@ private:
     void setVariantHash(const QVariantHash &vars);
     void setController(TActionController *controller);
     void setSubActionView(TActionView *actionView);
+    void setOutputDevice(QIODevice *device);
+    void flushIfFull();
     virtual const TActionView *actionView() const { return this; }
 
+    struct FragmentCacheEntry
+    {
+        QString key;
+        int lifeTime;
+        int position;  // -1: cache hit
+    };
+
     TActionController *actionController;
     TActionView *subView;
     QVariantHash variantHash;
+    QList<FragmentCacheEntry> fragmentCaches;
+    QIODevice *outputDevice;
 
     friend class TActionController;
     friend class TActionMailer;
@@ -68,6 +92,18 @@ inline void TActionView::setSubActionView(TActionView *actionView)
     subView = actionView;
 }
 
+inline void TActionView::setOutputDevice(QIODevice *device)
+{
+    outputDevice = device;
+}
+
+inline void TActionView::flushIfFull()
+{
+    if (outputDevice && responsebody.length() >= 16 * 1024) {
+        flushResponse();
+    }
+}
+
 inline const TActionController *TActionView::controller() const
 {
     return actionController;
@@ -95,37 +131,54 @@ inline bool TActionView::hasVariant(const QString &name) const
 
 inline QString TActionView::echo(const QString &str)
 {
-    responsebody += str;
+    responsebody += str.toUtf8();
+    flushIfFull();
     return QString();
 }
 
 inline QString TActionView::echo(const char *str)
 {
-    responsebody += QString(str);  // using codecForCStrings()
+    responsebody += str;  // UTF-8 string
+    flushIfFull();
+    return QString();
+}
+
+inline QString TActionView::echo(const char *str, int length)
+{
+    responsebody.append(str, length);  // UTF-8 string
+    flushIfFull();
     return QString();
 }
 
 inline QString TActionView::echo(const QByteArray &str)
 {
-    responsebody += QString(str);  // using codecForCStrings()
+    responsebody += str;  // UTF-8 string
+    flushIfFull();
     return QString();
 }
 
 inline QString TActionView::echo(int n, int base)
 {
-    responsebody += QString::number(n, base);
+    responsebody += QByteArray::number(n, base);
+    flushIfFull();
     return QString();  
 }
 
 inline QString TActionView::echo(double d, char format, int precision)
 {
-    responsebody += QString::number(d, format, precision);
+    responsebody += QByteArray::number(d, format, precision);
+    flushIfFull();
     return QString(); 
 }
 
 inline QString TActionView::echo(const QVariant &var)
 {
-    responsebody += var.toString();
+    if (var.type() == QVariant::ByteArray) {
+        responsebody += var.toByteArray();  // UTF-8 string
+    } else {
+        responsebody += var.toString().toUtf8();
+    }
+    flushIfFull();
     return QString();
 }
 
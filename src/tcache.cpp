@@ -0,0 +1,309 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDateTime>
+#include <TCache>
+
+/*!
+  \class TCache
+  \brief The TCache class provides a bounded in-process cache of byte
+  arrays with least-recently-used eviction and per-entry expiry.
+
+  The entries are distributed over several shards, each protected by
+  its own mutex, so that concurrent threads rarely wait on each other.
+  When a shard is full, the least recently used entry of the shard is
+  discarded.
+*/
+
+
+class TCache::Shard
+{
+public:
+    struct Node
+    {
+        QByteArray key;
+        QByteArray value;
+        uint expire;  // 0: never expires
+        Node *prev;
+        Node *next;
+    };
+
+    Shard(int max) : maxCount(qMax(max, 1)), head(0), tail(0), hits(0), misses(0) { }
+    ~Shard() { clear(); }
+
+    bool lookup(const QByteArray &key, QByteArray *value)
+    {
+        QMutexLocker locker(&mutex);
+        Node *node = hash.value(key);
+        if (!node) {
+            ++misses;
+            return false;
+        }
+
+        if (node->expire > 0 && node->expire <= QDateTime::currentDateTime().toTime_t()) {
+            unlink(node);
+            hash.remove(node->key);
+            delete node;
+            ++misses;
+            return false;
+        }
+
+        // Moves to the front of the list
+        unlink(node);
+        prepend(node);
+        ++hits;
+        if (value)
+            *value = node->value;
+        return true;
+    }
+
+    void insert(const QByteArray &key, const QByteArray &value, int lifeTime)
+    {
+        QMutexLocker locker(&mutex);
+        Node *node = hash.value(key);
+        if (node) {
+            unlink(node);
+        } else {
+            if (hash.count() >= maxCount && tail) {
+                // Discards the least recently used entry
+                Node *lru = tail;
+                unlink(lru);
+                hash.remove(lru->key);
+                delete lru;
+            }
+            node = new Node;
+            node->key = key;
+            hash.insert(key, node);
+        }
+        node->value = value;
+        node->expire = (lifeTime > 0) ? QDateTime::currentDateTime().toTime_t() + lifeTime : 0;
+        prepend(node);
+    }
+
+    bool remove(const QByteArray &key)
+    {
+        QMutexLocker locker(&mutex);
+        Node *node = hash.take(key);
+        if (!node)
+            return false;
+
+        unlink(node);
+        delete node;
+        return true;
+    }
+
+    int removeByPrefix(const QByteArray &prefix)
+    {
+        QMutexLocker locker(&mutex);
+        int cnt = 0;
+        Node *node = head;
+        while (node) {
+            Node *next = node->next;
+            if (node->key.startsWith(prefix)) {
+                unlink(node);
+                hash.remove(node->key);
+                delete node;
+                ++cnt;
+            }
+            node = next;
+        }
+        return cnt;
+    }
+
+    void clear()
+    {
+        QMutexLocker locker(&mutex);
+        qDeleteAll(hash);
+        hash.clear();
+        head = tail = 0;
+    }
+
+    int count() const
+    {
+        QMutexLocker locker(&mutex);
+        return hash.count();
+    }
+
+    quint64 hitCount() const
+    {
+        QMutexLocker locker(&mutex);
+        return hits;
+    }
+
+    quint64 missCount() const
+    {
+        QMutexLocker locker(&mutex);
+        return misses;
+    }
+
+private:
+    void unlink(Node *node)
+    {
+        if (node->prev)
+            node->prev->next = node->next;
+        else
+            head = node->next;
+
+        if (node->next)
+            node->next->prev = node->prev;
+        else
+            tail = node->prev;
+    }
+
+    void prepend(Node *node)
+    {
+        node->prev = 0;
+        node->next = head;
+        if (head)
+            head->prev = node;
+        head = node;
+        if (!tail)
+            tail = node;
+    }
+
+    int maxCount;
+    QHash<QByteArray, Node *> hash;
+    Node *head;
+    Node *tail;
+    quint64 hits;
+    quint64 misses;
+    mutable QMutex mutex;
+};
+
+/*!
+  Constructs a cache that holds up to \a maxEntries entries distributed
+  over \a shardCount shards.
+*/
+TCache::TCache(int maxEntries, int shardCount)
+    : maxCount(maxEntries)
+{
+    shardCount = qBound(1, shardCount, qMax(maxEntries, 1));
+    int perShard = (maxEntries + shardCount - 1) / shardCount;
+    for (int i = 0; i < shardCount; ++i) {
+        shards << new Shard(perShard);
+    }
+}
+
+/*!
+  Destroys the cache.
+*/
+TCache::~TCache()
+{
+    qDeleteAll(shards);
+}
+
+
+TCache::Shard *TCache::shard(const QByteArray &key) const
+{
+    return shards[qHash(key) % shards.count()];
+}
+
+/*!
+  Returns the value associated with the key \a key. If the cache
+  contains no live entry for the key, returns \a defaultValue.
+*/
+QByteArray TCache::value(const QByteArray &key, const QByteArray &defaultValue) const
+{
+    QByteArray val;
+    return shard(key)->lookup(key, &val) ? val : defaultValue;
+}
+
+/*!
+  Returns true if the cache contains a live entry for the key \a key;
+  otherwise returns false.
+*/
+bool TCache::contains(const QByteArray &key) const
+{
+    return shard(key)->lookup(key, 0);
+}
+
+/*!
+  Inserts a new entry with the key \a key and a value of \a value.
+  The entry expires after \a lifeTime seconds; if \a lifeTime is 0,
+  it is kept until it is evicted or removed.
+*/
+void TCache::insert(const QByteArray &key, const QByteArray &value, int lifeTime)
+{
+    shard(key)->insert(key, value, lifeTime);
+}
+
+/*!
+  Removes the entry with the key \a key from the cache.
+*/
+void TCache::remove(const QByteArray &key)
+{
+    shard(key)->remove(key);
+}
+
+/*!
+  Removes all the entries whose key starts with \a prefix and returns
+  the number of removed entries.
+*/
+int TCache::removeByPrefix(const QByteArray &prefix)
+{
+    int cnt = 0;
+    for (int i = 0; i < shards.count(); ++i) {
+        cnt += shards[i]->removeByPrefix(prefix);
+    }
+    return cnt;
+}
+
+/*!
+  Removes all the entries from the cache.
+*/
+void TCache::clear()
+{
+    for (int i = 0; i < shards.count(); ++i) {
+        shards[i]->clear();
+    }
+}
+
+/*!
+  Returns the number of entries in the cache, including entries which
+  have expired but have not been discarded yet.
+*/
+int TCache::count() const
+{
+    int cnt = 0;
+    for (int i = 0; i < shards.count(); ++i) {
+        cnt += shards[i]->count();
+    }
+    return cnt;
+}
+
+/*!
+  Returns the number of lookups that found a live entry.
+*/
+quint64 TCache::hitCount() const
+{
+    quint64 cnt = 0;
+    for (int i = 0; i < shards.count(); ++i) {
+        cnt += shards[i]->hitCount();
+    }
+    return cnt;
+}
+
+/*!
+  Returns the number of lookups that found no live entry.
+*/
+quint64 TCache::missCount() const
+{
+    quint64 cnt = 0;
+    for (int i = 0; i < shards.count(); ++i) {
+        cnt += shards[i]->missCount();
+    }
+    return cnt;
+}
+
+
+/*!
+  \fn int TCache::maxEntries() const
+  Returns the maximum number of entries the cache can hold.
+*/
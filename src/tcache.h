@@ -0,0 +1,36 @@
+#ifndef TCACHE_H
+#define TCACHE_H
+
+#include <QByteArray>
+#include <QVector>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TCache
+{
+public:
+    TCache(int maxEntries, int shardCount = 16);
+    ~TCache();
+
+    QByteArray value(const QByteArray &key, const QByteArray &defaultValue = QByteArray()) const;
+    bool contains(const QByteArray &key) const;
+    void insert(const QByteArray &key, const QByteArray &value, int lifeTime = 0);
+    void remove(const QByteArray &key);
+    int removeByPrefix(const QByteArray &prefix);
+    void clear();
+    int count() const;
+    int maxEntries() const { return maxCount; }
+    quint64 hitCount() const;
+    quint64 missCount() const;
+
+private:
+    class Shard;
+    Shard *shard(const QByteArray &key) const;
+
+    int maxCount;
+    QVector<Shard *> shards;
+
+    Q_DISABLE_COPY(TCache)
+};
+
+#endif // TCACHE_H
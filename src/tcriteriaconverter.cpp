@@ -6,8 +6,11 @@
  */
 
 #include <TCriteriaConverter>
+#include <TWebApplication>
 #include <QMutexLocker>
 
+#define MAX_ENTRIES_KEY  "SqlCriteriaCache.MaxEntries"
+
 /*!
  * \class TCriteriaConverter<>
  * \brief The TCriteriaConverter class is a template class that converts
@@ -19,6 +22,16 @@
 static QHash<int, QString> formatVector;
 static QMutex mutex;
 
+struct CompiledEntry
+{
+    QString sql;
+    quint64 lastUsed;
+};
+
+static QHash<QByteArray, CompiledEntry> compiledCache;  // key: shape
+static quint64 compiledTick = 0;
+static QMutex compiledMutex;
+
 
 const QHash<int, QString> &TCriteriaData::formats()
 {
@@ -50,3 +63,193 @@ const QHash<int, QString> &TCriteriaData::formats()
     }
     return formatVector;
 } 
+
+
+/*!
+  Constructs the shape of the criteria \a criteria for the ORM object
+  class \a metaObject and the database driver \a driverName, and
+  collects the values of the criteria in the order of the placeholders
+  of the SQL compiled from it.
+*/
+TCriteriaShape::TCriteriaShape(const TCriteria &criteria, const QMetaObject *metaObject, const QString &driverName)
+{
+    shapeKey.reserve(128);
+    shapeKey.append((const char *)&metaObject, sizeof(metaObject));
+    shapeKey.append(driverName.toLatin1()).append('\0');
+    compile(criteria);
+}
+
+/*!
+  Sets \a sql to the SQL compiled from a criteria of this shape and
+  returns true if it is cached; otherwise returns false.
+*/
+bool TCriteriaShape::find(QString &sql) const
+{
+    QMutexLocker locker(&compiledMutex);
+    QHash<QByteArray, CompiledEntry>::iterator it = compiledCache.find(shapeKey);
+    if (it == compiledCache.end()) {
+        return false;
+    }
+    it->lastUsed = ++compiledTick;
+    sql = it->sql;
+    return true;
+}
+
+/*!
+  Caches the SQL \a sql compiled from a criteria of this shape. The
+  least recently used one is discarded when the cache holds capacity()
+  entries.
+*/
+void TCriteriaShape::insert(const QString &sql) const
+{
+    int max = capacity();
+    if (max <= 0) {
+        return;
+    }
+
+    QMutexLocker locker(&compiledMutex);
+    if (!compiledCache.contains(shapeKey) && compiledCache.count() >= max) {
+        // Discards the least recently used SQL
+        QHash<QByteArray, CompiledEntry>::iterator lru = compiledCache.begin();
+        for (QHash<QByteArray, CompiledEntry>::iterator i = compiledCache.begin(); i != compiledCache.end(); ++i) {
+            if (i->lastUsed < lru->lastUsed)
+                lru = i;
+        }
+        compiledCache.erase(lru);
+    }
+
+    CompiledEntry entry;
+    entry.sql = sql;
+    entry.lastUsed = ++compiledTick;
+    compiledCache.insert(shapeKey, entry);
+}
+
+/*!
+  Discards all the cached SQL.
+*/
+void TCriteriaShape::clear()
+{
+    QMutexLocker locker(&compiledMutex);
+    compiledCache.clear();
+}
+
+/*!
+  Returns the maximum number of the cached SQL, which is indicated by
+  the value for application setting \a SqlCriteriaCache.MaxEntries.
+  0 disables the cache.
+*/
+int TCriteriaShape::capacity()
+{
+    static int maxEntries = Tf::app()->appSettings().value(MAX_ENTRIES_KEY, 1000).toInt();
+    return maxEntries;
+}
+
+
+void TCriteriaShape::compile(const TCriteria &cri)
+{
+    if (cri.isEmpty()) {
+        append('e');
+        return;
+    }
+    append('c');
+    append(cri.logicalOperator());
+    compile(cri.first());
+    compile(cri.second());
+}
+
+/*
+  Appends the node \a var to the key and its values to the bind values,
+  following the branches of TCriteriaConverter::criteriaToString().
+*/
+void TCriteriaShape::compile(const QVariant &var)
+{
+    if (var.isNull()) {
+        append('n');
+
+    } else if (var.canConvert<TCriteria>()) {
+        compile(var.value<TCriteria>());
+
+    } else if (var.canConvert<TCriteriaData>()) {
+        TCriteriaData cri = var.value<TCriteriaData>();
+        if (cri.isEmpty()) {
+            append('e');
+            return;
+        }
+
+        append('d');
+        append(cri.property);
+        append(cri.op1);
+        append(cri.op2);
+        append((cri.val1.isNull() ? 1 : 0) | (cri.val2.isNull() ? 2 : 0));
+
+        if (cri.op2 != TSql::Invalid && !cri.val1.isNull()) {
+            if (cri.op2 == TSql::Any || cri.op2 == TSql::All) {
+                QVariantList list = cri.val1.toList();
+                append(list.count());
+                bindValues << list;
+            }
+
+        } else if (!cri.val1.isNull() && !cri.val2.isNull()) {
+            switch (cri.op1) {
+            case TSql::LikeEscape:
+            case TSql::NotLikeEscape:
+            case TSql::ILikeEscape:
+            case TSql::NotILikeEscape:
+            case TSql::Between:
+            case TSql::NotBetween:
+                bindValues << cri.val1 << cri.val2;
+                break;
+            default:
+                break;
+            }
+
+        } else {
+            switch (cri.op1) {
+            case TSql::Equal:
+            case TSql::NotEqual:
+            case TSql::LessThan:
+            case TSql::GreaterThan:
+            case TSql::LessEqual:
+            case TSql::GreaterEqual:
+            case TSql::Like:
+            case TSql::NotLike:
+            case TSql::ILike:
+            case TSql::NotILike:
+                bindValues << cri.val1;
+                break;
+
+            case TSql::In:
+            case TSql::NotIn: {
+                QVariantList list = cri.val1.toList();
+                append(list.count());
+                bindValues << list;
+                break; }
+
+            case TSql::LikeEscape:
+            case TSql::NotLikeEscape:
+            case TSql::ILikeEscape:
+            case TSql::NotILikeEscape:
+            case TSql::Between:
+            case TSql::NotBetween: {
+                QVariantList list = cri.val1.toList();
+                append(list.count());
+                if (list.count() == 2) {
+                    bindValues << list;
+                }
+                break; }
+
+            default:
+                break;
+            }
+        }
+
+    } else {
+        append('x');
+    }
+}
+
+
+void TCriteriaShape::append(int n)
+{
+    shapeKey.append((const char *)&n, sizeof(n));
+}
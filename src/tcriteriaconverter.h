@@ -3,9 +3,11 @@
 
 #include <QMetaObject>
 #include <QVariant>
+#include <QByteArray>
 #include <QHash>
 #include <TCriteria>
 #include <TSqlQuery>
+#include <TSqlObjectMetaData>
 #include <TGlobal>
 #include "tsystemglobal.h"
 
@@ -72,18 +74,50 @@ inline bool TCriteriaData::isEmpty() const
 Q_DECLARE_METATYPE(TCriteriaData)
 
 
+/*!
+  TCriteriaShape class is a compact representation of the structure of
+  a criteria, without the values, for the cache of the SQL compiled from
+  criteria.
+  \sa TCriteriaConverter
+ */
+class T_CORE_EXPORT TCriteriaShape
+{
+public:
+    TCriteriaShape(const TCriteria &criteria, const QMetaObject *metaObject, const QString &driverName);
+    const QByteArray &key() const { return shapeKey; }
+    const QVariantList &values() const { return bindValues; }
+    bool find(QString &sql) const;
+    void insert(const QString &sql) const;
+
+    static void clear();
+    static int capacity();
+
+private:
+    void compile(const TCriteria &cri);
+    void compile(const QVariant &var);
+    void append(int n);
+
+    QByteArray shapeKey;
+    QVariantList bindValues;
+};
+
+
 template <class T>
 class TCriteriaConverter
 {
 public:
     TCriteriaConverter(const TCriteria &cri, const QSqlDatabase &db) : criteria(cri), database(db) { }
     QString toString() const;
+    QString toString(QVariantList &bindValues) const;
     static QString propertyName(int property);
+    static QVariant equalValue(const TCriteria &cri, int property);
 
 protected:
-    static QString criteriaToString(const QVariant &cri, const QSqlDatabase &database);
-    static QString criteriaToString(const QString &propertyName, TSql::ComparisonOperator op, const QVariant &val1, const QVariant &val2, const QSqlDatabase &database);
-    static QString criteriaToString(const QString &propertyName, TSql::ComparisonOperator op1, TSql::ComparisonOperator op2, const QVariant &val, const QSqlDatabase &database);
+    static QVariant equalValue(const QVariant &cri, int property);
+    static QString criteriaToString(const QVariant &cri, const QSqlDatabase &database, QVariantList *bindValues = 0);
+    static QString criteriaToString(const QString &propertyName, TSql::ComparisonOperator op, const QVariant &val1, const QVariant &val2, const QSqlDatabase &database, QVariantList *bindValues = 0);
+    static QString criteriaToString(const QString &propertyName, TSql::ComparisonOperator op1, TSql::ComparisonOperator op2, const QVariant &val, const QSqlDatabase &database, QVariantList *bindValues = 0);
+    static QString formatValue(const QVariant &val, const QSqlDatabase &database, QVariantList *bindValues);
     static QString join(const QString &s1, TCriteria::LogicalOperator op, const QString &s2);
 
 private:
@@ -98,9 +132,37 @@ inline QString TCriteriaConverter<T>::toString() const
     return criteriaToString(QVariant::fromValue(criteria), database);
 }
 
+/*!
+  Returns a SQL WHERE clause with '?' placeholders in place of the
+  values of the criteria, and appends the values to \a bindValues in
+  the order of the placeholders. The clause is compiled once per
+  structure of criteria and kept by TCriteriaShape, so that criteria
+  differing only in the values just collect the values.
+*/
+template <class T>
+inline QString TCriteriaConverter<T>::toString(QVariantList &bindValues) const
+{
+    TCriteriaShape shape(criteria, &T::staticMetaObject, database.driverName());
+    QString sql;
+    if (shape.find(sql)) {
+        bindValues << shape.values();
+        return sql;
+    }
+
+    QVariantList values;
+    sql = criteriaToString(QVariant::fromValue(criteria), database, &values);
+    if (values.count() == shape.values().count()) {
+        shape.insert(sql);
+    } else {
+        tSystemWarn("Criteria not cached, %d values bound but %d collected", values.count(), shape.values().count());
+    }
+    bindValues << values;
+    return sql;
+}
+
 
 template <class T>
-inline QString TCriteriaConverter<T>::criteriaToString(const QVariant &var, const QSqlDatabase &database)
+inline QString TCriteriaConverter<T>::criteriaToString(const QVariant &var, const QSqlDatabase &database, QVariantList *bindValues)
 {
     QString sqlString;
     if (var.isNull()) {
@@ -112,8 +174,8 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QVariant &var, cons
         if (cri.isEmpty()) {
             return QString();
         }
-        sqlString = join(criteriaToString(cri.first(), database), cri.logicalOperator(),
-                         criteriaToString(cri.second(), database));
+        sqlString = join(criteriaToString(cri.first(), database, bindValues), cri.logicalOperator(),
+                         criteriaToString(cri.second(), database, bindValues));
     
     } else if (var.canConvert<TCriteriaData>()) {
         TCriteriaData cri = var.value<TCriteriaData>();
@@ -121,17 +183,16 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QVariant &var, cons
             return QString();
         }
         
-        QString name = propertyName(cri.property);
+        QString name = TSqlObjectMetaData::get<T>(database)->escapedPropertyName(cri.property);
         if (name.isEmpty()) {
             return QString();
         }
-        name = TSqlQuery::escapeIdentifier(name, QSqlDriver::FieldName, database);
         
         if (cri.op1 != TSql::Invalid && cri.op2 != TSql::Invalid && !cri.val1.isNull()) {
-            sqlString += criteriaToString(name, (TSql::ComparisonOperator)cri.op1, (TSql::ComparisonOperator)cri.op2, cri.val1, database);
+            sqlString += criteriaToString(name, (TSql::ComparisonOperator)cri.op1, (TSql::ComparisonOperator)cri.op2, cri.val1, database, bindValues);
             
         } else if (cri.op1 != TSql::Invalid && !cri.val1.isNull() && !cri.val2.isNull()) {
-            sqlString += criteriaToString(name, (TSql::ComparisonOperator)cri.op1, cri.val1, cri.val2, database);
+            sqlString += criteriaToString(name, (TSql::ComparisonOperator)cri.op1, cri.val1, cri.val2, database, bindValues);
             
         } else if (cri.op1 != TSql::Invalid) {
             switch(cri.op1) {
@@ -145,16 +206,16 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QVariant &var, cons
             case TSql::NotLike:
             case TSql::ILike:
             case TSql::NotILike:
-                sqlString += name + TCriteriaData::formats().value(cri.op1).arg(TSqlQuery::formatValue(cri.val1, database));
+                sqlString += name + TCriteriaData::formats().value(cri.op1).arg(formatValue(cri.val1, database, bindValues));
                 break;
                 
             case TSql::In:
             case TSql::NotIn: {
                 QString str;
-                QList<QVariant> list;
+                QList<QVariant> list = cri.val1.toList();
                 QListIterator<QVariant> i(list);
                 while (i.hasNext()) {
-                    QString s = TSqlQuery::formatValue(i.next(), database);
+                    QString s = formatValue(i.next(), database, bindValues);
                     if (!s.isEmpty()) {
                         str.append(s).append(',');
                     }
@@ -175,7 +236,7 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QVariant &var, cons
             case TSql::NotBetween: {
                 QList<QVariant> list = cri.val1.toList();
                 if (list.count() == 2) {
-                    sqlString += criteriaToString(name, (TSql::ComparisonOperator)cri.op1, list[0], list[1], database);
+                    sqlString += criteriaToString(name, (TSql::ComparisonOperator)cri.op1, list[0], list[1], database, bindValues);
                 }
                 break; }
                 
@@ -203,17 +264,50 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QVariant &var, cons
 template <class T>
 inline QString TCriteriaConverter<T>::propertyName(int property)
 {
-    const QMetaObject *metaObject = T().metaObject();
-    return (metaObject) ? metaObject->property(metaObject->propertyOffset() + property).name() : QString();
+    const QMetaObject &metaObject = T::staticMetaObject;
+    return (property >= 0) ? QString(metaObject.property(metaObject.propertyOffset() + property).name()) : QString();
+}
+
+
+/*!
+  Returns the value which the property \a property equals in all the
+  rows matching the criteria \a cri, or a null QVariant unless an
+  'Equal' condition of the property is ANDed with the others.
+*/
+template <class T>
+inline QVariant TCriteriaConverter<T>::equalValue(const TCriteria &cri, int property)
+{
+    return equalValue(QVariant::fromValue(cri), property);
+}
+
+
+template <class T>
+inline QVariant TCriteriaConverter<T>::equalValue(const QVariant &var, int property)
+{
+    if (var.canConvert<TCriteria>()) {
+        TCriteria cri = var.value<TCriteria>();
+        if (cri.isEmpty() || cri.logicalOperator() == TCriteria::Or) {
+            return QVariant();
+        }
+        QVariant val = equalValue(cri.first(), property);
+        return (val.isNull()) ? equalValue(cri.second(), property) : val;
+
+    } else if (var.canConvert<TCriteriaData>()) {
+        TCriteriaData cri = var.value<TCriteriaData>();
+        if (cri.property == property && cri.op1 == TSql::Equal && cri.op2 == TSql::Invalid) {
+            return cri.val1;
+        }
+    }
+    return QVariant();
 }
 
 
 template <class T>
-inline QString TCriteriaConverter<T>::criteriaToString(const QString &propertyName, TSql::ComparisonOperator op, const QVariant &val1, const QVariant &val2, const QSqlDatabase &database)
+inline QString TCriteriaConverter<T>::criteriaToString(const QString &propertyName, TSql::ComparisonOperator op, const QVariant &val1, const QVariant &val2, const QSqlDatabase &database, QVariantList *bindValues)
 {
     QString sqlString;
-    QString v1 = TSqlQuery::formatValue(val1, database);
-    QString v2 = TSqlQuery::formatValue(val2, database);
+    QString v1 = formatValue(val1, database, bindValues);
+    QString v2 = formatValue(val2, database, bindValues);
     
     if (!v1.isEmpty() && !v2.isEmpty()) {
         switch(op) {
@@ -227,6 +321,11 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QString &propertyNa
             break;
             
         default:
+            if (bindValues) {
+                // Discards the values of no placeholder
+                bindValues->removeLast();
+                bindValues->removeLast();
+            }
             tWarn("Invalid parameters  [%s:%d]", __FILE__, __LINE__);
             break;
         }
@@ -238,7 +337,7 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QString &propertyNa
 
 
 template <class T>
-inline QString TCriteriaConverter<T>::criteriaToString(const QString &propertyName, TSql::ComparisonOperator op1, TSql::ComparisonOperator op2, const QVariant &val, const QSqlDatabase &database)
+inline QString TCriteriaConverter<T>::criteriaToString(const QString &propertyName, TSql::ComparisonOperator op1, TSql::ComparisonOperator op2, const QVariant &val, const QSqlDatabase &database, QVariantList *bindValues)
 {
     QString sqlString;
     if (op1 != TSql::Invalid && op2 != TSql::Invalid && !val.isNull()) {
@@ -249,7 +348,7 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QString &propertyNa
             QList<QVariant> list = val.toList();
             QListIterator<QVariant> i(list);
             while (i.hasNext()) {
-                QString s = TSqlQuery::formatValue(i.next(), database);
+                QString s = formatValue(i.next(), database, bindValues);
                 if (!s.isEmpty()) {
                     str.append(s).append(',');
                 } 
@@ -271,6 +370,22 @@ inline QString TCriteriaConverter<T>::criteriaToString(const QString &propertyNa
 }
 
 
+/*!
+  Returns a string representation of the value \a val, or a '?'
+  placeholder if \a bindValues is not 0. In the latter case, the value
+  is appended to \a bindValues.
+*/
+template <class T>
+inline QString TCriteriaConverter<T>::formatValue(const QVariant &val, const QSqlDatabase &database, QVariantList *bindValues)
+{
+    if (bindValues) {
+        bindValues->append(val);
+        return QString(QLatin1Char('?'));
+    }
+    return TSqlQuery::formatValue(val, database);
+}
+
+
 template <class T>
 inline QString TCriteriaConverter<T>::join(const QString &s1, TCriteria::LogicalOperator op, const QString &s2)
 {
@@ -0,0 +1,85 @@
+#include <QTest>
+#include <QByteArray>
+#include <tcache.h>
+
+
+class TestCache : public QObject
+{
+    Q_OBJECT
+private slots:
+    void insertAndValue();
+    void lruEviction();
+    void expiry();
+    void removeByPrefix();
+};
+
+
+void TestCache::insertAndValue()
+{
+    TCache cache(100, 4);
+    cache.insert("foo", "bar");
+    cache.insert("hoge", "fuga", 60);
+    QCOMPARE(cache.value("foo"), QByteArray("bar"));
+    QCOMPARE(cache.value("hoge"), QByteArray("fuga"));
+    QCOMPARE(cache.value("none", "default"), QByteArray("default"));
+    QCOMPARE(cache.count(), 2);
+    QCOMPARE(cache.hitCount(), (quint64)2);
+    QCOMPARE(cache.missCount(), (quint64)1);
+
+    cache.insert("foo", "baz");
+    QCOMPARE(cache.value("foo"), QByteArray("baz"));
+    QCOMPARE(cache.count(), 2);
+
+    cache.remove("foo");
+    QVERIFY(!cache.contains("foo"));
+    cache.clear();
+    QCOMPARE(cache.count(), 0);
+}
+
+
+void TestCache::lruEviction()
+{
+    TCache cache(3, 1);
+    cache.insert("a", "1");
+    cache.insert("b", "2");
+    cache.insert("c", "3");
+    QVERIFY(cache.contains("a"));  // 'b' becomes the least recently used
+    cache.insert("d", "4");
+
+    QCOMPARE(cache.count(), 3);
+    QVERIFY(cache.contains("a"));
+    QVERIFY(!cache.contains("b"));
+    QVERIFY(cache.contains("c"));
+    QVERIFY(cache.contains("d"));
+}
+
+
+void TestCache::expiry()
+{
+    TCache cache(10, 1);
+    cache.insert("short", "1", 1);
+    cache.insert("long", "2", 60);
+    QVERIFY(cache.contains("short"));
+    QTest::qSleep(2100);
+    QVERIFY(!cache.contains("short"));
+    QVERIFY(cache.contains("long"));
+}
+
+
+void TestCache::removeByPrefix()
+{
+    TCache cache(100);
+    cache.insert("blog#index\n/blog", "1");
+    cache.insert("blog#show\n/blog/show/1", "2");
+    cache.insert("blog#show\n/blog/show/2", "3");
+    cache.insert("user#show\n/user/show/1", "4");
+
+    QCOMPARE(cache.removeByPrefix("blog#show\n"), 2);
+    QVERIFY(cache.contains("blog#index\n/blog"));
+    QCOMPARE(cache.removeByPrefix("blog#"), 1);
+    QCOMPARE(cache.count(), 1);
+}
+
+
+QTEST_APPLESS_MAIN(TestCache)
+#include "main.moc"
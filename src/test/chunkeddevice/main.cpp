@@ -0,0 +1,109 @@
+#include <QTest>
+#include <QByteArray>
+#include <thttpchunkeddevice.h>
+
+/*
+  Output device which keeps the data written as pending until
+  waitForBytesWritten() is called, like a socket whose peer is slow.
+*/
+class SlowDevice : public QIODevice
+{
+public:
+    SlowDevice() : QIODevice(), pending(0), maxPending(0), waits(0) { open(QIODevice::WriteOnly); }
+    qint64 bytesToWrite() const { return pending; }
+    bool waitForBytesWritten(int)
+    {
+        ++waits;
+        pending = qMax(pending - 16 * 1024, (qint64)0);
+        return true;
+    }
+
+    QByteArray output;
+    qint64 pending;
+    qint64 maxPending;
+    int waits;
+
+protected:
+    qint64 readData(char *, qint64) { return -1; }
+    qint64 writeData(const char *data, qint64 size)
+    {
+        output.append(data, size);
+        pending += size;
+        maxPending = qMax(maxPending, pending);
+        return size;
+    }
+};
+
+
+class TestChunkedDevice : public QObject
+{
+    Q_OBJECT
+private slots:
+    void chunkFraming();
+    void emptyWrite();
+    void noChunkedEncoding();
+    void backpressure();
+};
+
+
+void TestChunkedDevice::chunkFraming()
+{
+    SlowDevice out;
+    THttpChunkedDevice device(&out);
+    device.open(QIODevice::WriteOnly);
+    QCOMPARE(device.write("Hello"), (qint64)5);
+    QCOMPARE(device.write(QByteArray(26, 'x')), (qint64)26);
+    device.close();
+
+    QByteArray expect = "5\r\nHello\r\n1a\r\n" + QByteArray(26, 'x') + "\r\n0\r\n\r\n";
+    QCOMPARE(out.output, expect);
+    QCOMPARE(device.bytesSent(), (qint64)expect.length());
+}
+
+
+void TestChunkedDevice::emptyWrite()
+{
+    SlowDevice out;
+    THttpChunkedDevice device(&out);
+    device.open(QIODevice::WriteOnly);
+    QCOMPARE(device.write(QByteArray()), (qint64)0);
+    device.close();
+    device.close();  // the last chunk is written once
+    QCOMPARE(out.output, QByteArray("0\r\n\r\n"));
+}
+
+
+void TestChunkedDevice::noChunkedEncoding()
+{
+    SlowDevice out;
+    THttpChunkedDevice device(&out, false);
+    device.open(QIODevice::WriteOnly);
+    device.write("Hello ");
+    device.write("world");
+    device.close();
+    QCOMPARE(out.output, QByteArray("Hello world"));
+    QCOMPARE(device.bytesSent(), (qint64)11);
+}
+
+
+void TestChunkedDevice::backpressure()
+{
+    SlowDevice out;
+    THttpChunkedDevice device(&out);
+    device.open(QIODevice::WriteOnly);
+
+    QByteArray data(10 * 1024, 'a');
+    for (int i = 0; i < 100; ++i) {
+        QCOMPARE(device.write(data), (qint64)data.length());
+        QVERIFY(out.bytesToWrite() <= 64 * 1024);
+    }
+    device.close();
+
+    QVERIFY(out.waits > 0);
+    QVERIFY(out.maxPending <= 64 * 1024 + data.length() + 16);  // a chunk over the limit
+    QVERIFY(out.output.endsWith("0\r\n\r\n"));
+}
+
+
+QTEST_APPLESS_MAIN(TestChunkedDevice)
+#include "main.moc"
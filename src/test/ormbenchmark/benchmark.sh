@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Runs the ORM benchmarks on the SQLite files and on the in-memory
+# database, and compares the results with baseline.txt. The results
+# slower than the baseline by more than THRESHOLD percent are reported
+# as regressions, which fail the run. The results without a baseline
+# are warned, until it is recorded by running with '-update'.
+#
+
+cd `dirname $0`
+LD_LIBRARY_PATH=../..
+export LD_LIBRARY_PATH
+THRESHOLD=${THRESHOLD:-20}
+RESULTS=benchmark.results
+
+# Prints the results as lines of 'database.function value unit'
+run()
+{
+  if ! ./ormbenchmark $1 > $2.log 2>&1; then
+    cat $2.log
+    echo "Benchmark failed: $2"
+    exit 1
+  fi
+  awk -v db=$2 '
+    /^RESULT : / { name = $3; sub(/^OrmBenchmark::/, "", name); sub(/\(\):$/, "", name); next }
+    name != "" && / per iteration/ { print db "." name, $1, $2; name = "" }' $2.log
+}
+
+run "" file > $RESULTS
+run -memory memory >> $RESULTS
+
+if [ "$1" = "-update" ]; then
+  grep '^#' baseline.txt > baseline.tmp
+  cat $RESULTS >> baseline.tmp
+  mv baseline.tmp baseline.txt
+  echo "Baseline updated."
+  exit 0
+fi
+
+awk -v threshold=$THRESHOLD '
+  FNR == NR { if ($1 !~ /^#/ && NF == 3) { base[$1] = $2; unit[$1] = $3 } next }
+  {
+    if (!($1 in base) || unit[$1] != $3) {
+      printf "%-36s %12s %-6s  NO BASELINE\n", $1, $2, $3
+      missing++
+      next
+    }
+    diff = (base[$1] > 0) ? ($2 / base[$1] - 1) * 100 : 0
+    mark = ""
+    if (diff > threshold) {
+      mark = "  REGRESSION"
+      regressions++
+    }
+    printf "%-36s %12s %-6s %+7.1f%%%s\n", $1, $2, $3, diff, mark
+  }
+  END {
+    if (missing > 0) {
+      printf "Warning: %d result(s) without a baseline; record it by benchmark.sh -update\n", missing
+    }
+    if (regressions > 0) {
+      printf "%d regression(s) over %d%%\n", regressions, threshold
+      exit 1
+    }
+  }' baseline.txt $RESULTS
@@ -0,0 +1,46 @@
+#ifndef BLOGOBJECT_H
+#define BLOGOBJECT_H
+
+#include <TSqlObject>
+#include <QSharedData>
+
+
+class BlogObject : public TSqlObject, public QSharedData
+{
+public:
+    int id;
+    QString title;
+    QString body;
+    QDateTime created_at;
+    QDateTime updated_at;
+    int lock_revision;
+
+    enum PropertyIndex {
+        Id = 0,
+        Title,
+        Body,
+        CreatedAt,
+        UpdatedAt,
+        LockRevision,
+    };
+
+    int primaryKeyIndex() const { return Id; }
+    int autoValueIndex() const { return Id; }
+
+private:    /*** Don't modify below this line ***/
+    Q_OBJECT
+    Q_PROPERTY(int id READ getid WRITE setid)
+    T_DEFINE_PROPERTY(int, id)
+    Q_PROPERTY(QString title READ gettitle WRITE settitle)
+    T_DEFINE_PROPERTY(QString, title)
+    Q_PROPERTY(QString body READ getbody WRITE setbody)
+    T_DEFINE_PROPERTY(QString, body)
+    Q_PROPERTY(QDateTime created_at READ getcreated_at WRITE setcreated_at)
+    T_DEFINE_PROPERTY(QDateTime, created_at)
+    Q_PROPERTY(QDateTime updated_at READ getupdated_at WRITE setupdated_at)
+    T_DEFINE_PROPERTY(QDateTime, updated_at)
+    Q_PROPERTY(int lock_revision READ getlock_revision WRITE setlock_revision)
+    T_DEFINE_PROPERTY(int, lock_revision)
+};
+
+#endif // BLOGOBJECT_H
@@ -0,0 +1,34 @@
+#ifndef COMMENTOBJECT_H
+#define COMMENTOBJECT_H
+
+#include <TSqlObject>
+#include <QSharedData>
+
+
+class CommentObject : public TSqlObject, public QSharedData
+{
+public:
+    int id;
+    int blog_id;
+    QString body;
+
+    enum PropertyIndex {
+        Id = 0,
+        BlogId,
+        Body,
+    };
+
+    int primaryKeyIndex() const { return Id; }
+    int autoValueIndex() const { return Id; }
+
+private:    /*** Don't modify below this line ***/
+    Q_OBJECT
+    Q_PROPERTY(int id READ getid WRITE setid)
+    T_DEFINE_PROPERTY(int, id)
+    Q_PROPERTY(int blog_id READ getblog_id WRITE setblog_id)
+    T_DEFINE_PROPERTY(int, blog_id)
+    Q_PROPERTY(QString body READ getbody WRITE setbody)
+    T_DEFINE_PROPERTY(QString, body)
+};
+
+#endif // COMMENTOBJECT_H
@@ -0,0 +1,34 @@
+#ifndef ENTRYOBJECT_H
+#define ENTRYOBJECT_H
+
+#include <TSqlObject>
+#include <QSharedData>
+
+
+class EntryObject : public TSqlObject, public QSharedData
+{
+public:
+    int id;
+    int user_id;
+    QString title;
+
+    enum PropertyIndex {
+        Id = 0,
+        UserId,
+        Title,
+    };
+
+    int primaryKeyIndex() const { return Id; }
+    int shardKeyIndex() const { return UserId; }
+
+private:    /*** Don't modify below this line ***/
+    Q_OBJECT
+    Q_PROPERTY(int id READ getid WRITE setid)
+    T_DEFINE_PROPERTY(int, id)
+    Q_PROPERTY(int user_id READ getuser_id WRITE setuser_id)
+    T_DEFINE_PROPERTY(int, user_id)
+    Q_PROPERTY(QString title READ gettitle WRITE settitle)
+    T_DEFINE_PROPERTY(QString, title)
+};
+
+#endif // ENTRYOBJECT_H
@@ -0,0 +1,886 @@
+#include <TfTest/TfTest>
+#include <QElapsedTimer>
+#include <QScopedPointer>
+#include <TActionContext>
+#include <TSqlObject>
+#include <TSqlORMapper>
+#include <TSqlQueryORMapper>
+#include <TSqlORMapperIterator>
+#include <TSqlORMapperCursor>
+#include <TSqlQuery>
+#include <TSqlStatementCache>
+#include <TSqlResultCache>
+#include <TSqlQueryStatistics>
+#include <TSqlDatabasePool>
+#include <TSqlAsyncQuery>
+#include <TCriteriaConverter>
+#include <TSessionStore>
+#include "blogobject.h"
+#include "entryobject.h"
+#include "commentobject.h"
+#include "tsessionstorefactory.h"
+
+#if QT_VERSION >= 0x050000
+# define SKIP(msg)  QSKIP(msg)
+#else
+# define SKIP(msg)  QSKIP(msg, SkipSingle)
+#endif
+
+const int STATEMENT_COUNT = 1000;
+const int CHURN_COUNT = 1000;
+const int BATCH_COUNT = 600;
+const char CREATE_BLOG_TABLE[] = "CREATE TABLE blog (id INTEGER PRIMARY KEY AUTOINCREMENT, title VARCHAR(20), body TEXT, created_at TIMESTAMP, updated_at TIMESTAMP, lock_revision INTEGER)";
+const char CREATE_ENTRY_TABLE[] = "CREATE TABLE entry (id INTEGER PRIMARY KEY, user_id INTEGER, title VARCHAR(20))";
+const char CREATE_SESSION_TABLE[] = "CREATE TABLE session (id VARCHAR(50) PRIMARY KEY, data BLOB, updated_at TIMESTAMP)";
+const char CREATE_COMMENT_TABLE[] = "CREATE TABLE comment (id INTEGER PRIMARY KEY AUTOINCREMENT, blog_id INTEGER, body TEXT)";
+
+
+class OrmBenchmark : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void insertLiteral();
+    void insertPrepared();
+    void findLiteral();
+    void findPrepared();
+    void updatePrepared();
+    void criteriaToSql();
+    void createUpdateRemove();
+    void insertAll();
+    void updateAll();
+    void iterateAll();
+    void iterateCopy();
+    void cursorAll();
+    void findCount();
+    void exists();
+    void pageByOffset();
+    void pageByKeyset();
+    void projection();
+    void includeHasMany();
+    void poolPopPush();
+    void poolChurn();
+    void resultCache();
+    void queryStatistics();
+    void statementsPerSecond();
+    void readFromReplica();
+    void findAsync();
+    void shardByKey();
+    void upsert();
+    void storeSession();
+    void loadQueryFile();
+
+private:
+    static bool inMemory();
+    static void startOver();
+    bool execLiteralInsert(BlogObject &blog);
+    BlogObject execLiteralFind(int id);
+    int insertedId;
+};
+
+
+void OrmBenchmark::initTestCase()
+{
+    TSqlQuery query;
+    QVERIFY(query.exec("DROP TABLE IF EXISTS blog"));
+    QVERIFY(query.exec(CREATE_BLOG_TABLE));
+
+    BlogObject blog;
+    blog.title = "Hello";
+    blog.body = "Hello world";
+    QVERIFY(blog.create());
+    insertedId = blog.id;
+}
+
+/*
+  Returns true if the suite runs on the in-memory database, in which
+  each connection opens its own database.
+*/
+bool OrmBenchmark::inMemory()
+{
+    return TSqlDatabasePool::instance()->environment() == "memory";
+}
+
+/*
+  Commits the writes so far and starts over as a request which has not
+  written yet, so that the mappers use the result cache.
+*/
+void OrmBenchmark::startOver()
+{
+    TActionContext::current()->getDatabase(0).commit();
+    TActionContext::current()->releaseDatabases();
+}
+
+/*
+  Builds the INSERT statement with literal values and executes it
+  without preparing, as the ORM did before the statement cache.
+*/
+bool OrmBenchmark::execLiteralInsert(BlogObject &blog)
+{
+    QSqlDatabase &db = TActionContext::current()->getDatabase(0);
+    QSqlRecord rec = db.record(blog.tableName());
+    rec.remove(rec.indexOf("id"));
+    rec.setValue("title", blog.title);
+    rec.setValue("body", blog.body);
+    rec.setValue("created_at", QDateTime::currentDateTime());
+    rec.setValue("updated_at", QDateTime::currentDateTime());
+    rec.setValue("lock_revision", 1);
+
+    QString ins = db.driver()->sqlStatement(QSqlDriver::InsertStatement, blog.tableName(), rec, false);
+    QSqlQuery query(db);
+    return query.exec(ins);
+}
+
+
+BlogObject OrmBenchmark::execLiteralFind(int id)
+{
+    QSqlDatabase &db = TActionContext::current()->getDatabase(0);
+    QString sel = db.driver()->sqlStatement(QSqlDriver::SelectStatement, "blog", db.record("blog"), false);
+    sel += " WHERE id=" + TSqlQuery::formatValue(id, db) + " LIMIT 1";
+
+    BlogObject blog;
+    QSqlQuery query(db);
+    if (query.exec(sel) && query.next()) {
+        blog.setRecord(query.record(), QSqlError());
+    }
+    return blog;
+}
+
+
+void OrmBenchmark::insertLiteral()
+{
+    BlogObject blog;
+    blog.title = "Hello";
+    blog.body = "Hello world";
+
+    QBENCHMARK {
+        QVERIFY(execLiteralInsert(blog));
+    }
+}
+
+
+void OrmBenchmark::insertPrepared()
+{
+    QBENCHMARK {
+        BlogObject blog;
+        blog.title = "Hello";
+        blog.body = "Hello world";
+        QVERIFY(blog.create());
+    }
+}
+
+
+void OrmBenchmark::findLiteral()
+{
+    QBENCHMARK {
+        BlogObject blog = execLiteralFind(insertedId);
+        QCOMPARE(blog.id, insertedId);
+    }
+}
+
+
+void OrmBenchmark::findPrepared()
+{
+    TSqlORMapper<BlogObject> mapper;
+    QBENCHMARK {
+        BlogObject blog = mapper.findByPrimaryKey(insertedId);
+        QCOMPARE(blog.id, insertedId);
+    }
+}
+
+
+void OrmBenchmark::updatePrepared()
+{
+    TSqlORMapper<BlogObject> mapper;
+    BlogObject blog = mapper.findByPrimaryKey(insertedId);
+    QVERIFY(!blog.isNull());
+
+    int i = 0;
+    QBENCHMARK {
+        blog.body = QString::number(++i);
+        QVERIFY(blog.update());
+    }
+}
+
+
+void OrmBenchmark::insertAll()
+{
+    QList<BlogObject> blogs;
+    for (int i = 0; i < 100; ++i) {
+        BlogObject blog;
+        blog.title = "Hello";
+        blog.body = QString::number(i);
+        blogs << blog;
+    }
+
+    TSqlORMapper<BlogObject> mapper;
+    QVariantList ids;
+    QCOMPARE(mapper.insertAll(blogs, &ids), 100);
+    QCOMPARE(ids.count(), 100);
+    QCOMPARE(mapper.findByPrimaryKey(ids.last()).body, QString("99"));
+
+    QBENCHMARK {
+        QCOMPARE(mapper.insertAll(blogs), 100);
+    }
+}
+
+
+void OrmBenchmark::updateAll()
+{
+    TSqlORMapper<BlogObject> mapper;
+    BlogObject blog = mapper.findByPrimaryKey(insertedId);
+    QMap<int, QVariant> values;
+    values.insert(BlogObject::Title, "Updated");
+
+    QCOMPARE(mapper.updateAll(TCriteria(BlogObject::Id, insertedId), values), 1);
+    BlogObject updated = mapper.findByPrimaryKey(insertedId);
+    QCOMPARE(updated.title, QString("Updated"));
+    QCOMPARE(updated.lock_revision, blog.lock_revision + 1);
+
+    QBENCHMARK {
+        QCOMPARE(mapper.updateAll(TCriteria(BlogObject::Id, insertedId), values), 1);
+    }
+}
+
+
+void OrmBenchmark::criteriaToSql()
+{
+    TCriteria cri(BlogObject::Title, QString("Hello"));
+    cri.add(BlogObject::Id, TSql::GreaterThan, insertedId);
+    cri.addOr(BlogObject::Id, TSql::In, QVariantList() << 1 << 2 << 3);
+    QSqlDatabase &db = TActionContext::current()->getDatabase(0);
+
+    // Same structure, other values: same SQL
+    TCriteria cri2(BlogObject::Title, QString("World"));
+    cri2.add(BlogObject::Id, TSql::GreaterThan, insertedId + 1);
+    cri2.addOr(BlogObject::Id, TSql::In, QVariantList() << 4 << 5 << 6);
+    QVariantList values1, values2;
+    QString sql = TCriteriaConverter<BlogObject>(cri, db).toString(values1);
+    QCOMPARE(TCriteriaConverter<BlogObject>(cri2, db).toString(values2), sql);
+    QCOMPARE(values2.count(), values1.count());
+    QCOMPARE(values2.first().toString(), QString("World"));
+    QCOMPARE(values2.last().toInt(), 6);
+
+    // Another length of the list: other SQL
+    TCriteria cri3(BlogObject::Title, QString("Hello"));
+    cri3.add(BlogObject::Id, TSql::GreaterThan, insertedId);
+    cri3.addOr(BlogObject::Id, TSql::In, QVariantList() << 1 << 2);
+    QVariantList values3;
+    QVERIFY(TCriteriaConverter<BlogObject>(cri3, db).toString(values3) != sql);
+    QCOMPARE(values3.count(), 4);
+
+    QBENCHMARK {
+        QVariantList values;
+        TCriteriaConverter<BlogObject> conv(cri, db);
+        QVERIFY(!conv.toString(values).isEmpty());
+        QCOMPARE(values.count(), 5);
+    }
+}
+
+
+void OrmBenchmark::createUpdateRemove()
+{
+    QBENCHMARK {
+        BlogObject blog;
+        blog.title = "Hello";
+        blog.body = "Hello world";
+        QVERIFY(blog.create());
+        blog.body = "Updated";
+        QVERIFY(blog.update());
+        QVERIFY(blog.remove());
+    }
+}
+
+
+void OrmBenchmark::iterateAll()
+{
+    TSqlORMapper<BlogObject> mapper;
+    QBENCHMARK {
+        int cnt = mapper.find();
+        TSqlORMapperIterator<BlogObject> it(mapper);
+        while (it.hasNext()) {
+            it.next();
+            --cnt;
+        }
+        QCOMPARE(cnt, 0);
+    }
+}
+
+
+void OrmBenchmark::iterateCopy()
+{
+    TSqlORMapper<BlogObject> mapper;
+    int count = mapper.find();
+
+    QBENCHMARK {
+        QList<BlogObject> blogs;
+        TSqlORMapperIterator<BlogObject> it(mapper);
+        while (it.hasNext()) {
+            blogs << it.next();
+        }
+        QCOMPARE(blogs.count(), count);
+    }
+}
+
+
+void OrmBenchmark::cursorAll()
+{
+    TSqlORMapper<BlogObject> mapper;
+    int count = mapper.find();
+
+    QBENCHMARK {
+        int cnt = 0;
+        BlogObject blog;
+        TSqlORMapperCursor<BlogObject> cursor(mapper);
+        while (cursor.next(blog)) {
+            ++cnt;
+        }
+        QCOMPARE(cnt, count);
+    }
+}
+
+
+void OrmBenchmark::findCount()
+{
+    TSqlORMapper<BlogObject> mapper;
+    int count = mapper.find();
+
+    QBENCHMARK {
+        QCOMPARE(mapper.findCount(), count);
+    }
+}
+
+
+void OrmBenchmark::exists()
+{
+    TSqlORMapper<BlogObject> mapper;
+    QVERIFY(!mapper.exists(TCriteria(BlogObject::Id, -1)));
+
+    QBENCHMARK {
+        QVERIFY(mapper.exists(TCriteria(BlogObject::Id, insertedId)));
+    }
+}
+
+
+void OrmBenchmark::pageByOffset()
+{
+    TSqlORMapper<BlogObject> mapper;
+    int count = mapper.findCount();
+    mapper.setSortOrder(BlogObject::Id, TSql::AscendingOrder);
+    mapper.setLimit(20);
+    mapper.setOffset(count - 20);
+
+    QBENCHMARK {
+        QCOMPARE(mapper.find(), 20);
+    }
+}
+
+
+void OrmBenchmark::pageByKeyset()
+{
+    TSqlORMapper<BlogObject> mapper;
+    int count = mapper.findCount();
+    mapper.setSortOrder(BlogObject::Id, TSql::AscendingOrder);
+    mapper.setLimit(1);
+    mapper.setOffset(count - 21);
+    mapper.find();
+    int lastId = mapper.first().id;
+
+    QCOMPARE(mapper.findAfter(BlogObject::Id, QVariant(), 20), 20);
+    QCOMPARE(mapper.first().id, insertedId);
+
+    QBENCHMARK {
+        QCOMPARE(mapper.findAfter(BlogObject::Id, lastId, 20), 20);
+    }
+}
+
+
+void OrmBenchmark::projection()
+{
+    TSqlORMapper<BlogObject> mapper;
+    QList<int> columns;
+    columns << BlogObject::Title;
+    mapper.setProjection(columns);
+
+    BlogObject blog = mapper.findByPrimaryKey(insertedId);
+    QCOMPARE(blog.id, insertedId);
+    QVERIFY(!blog.title.isEmpty());
+    QVERIFY(blog.body.isEmpty());
+
+    QBENCHMARK {
+        QVERIFY(mapper.find() > 0);
+    }
+}
+
+
+/*
+  The blogs are more than a batch of keys, and they and their comments
+  are more than the rows which the SQLite driver fetches at first.
+*/
+void OrmBenchmark::includeHasMany()
+{
+    TSqlQuery query;
+    QVERIFY(query.exec("DROP TABLE IF EXISTS comment"));
+    QVERIFY(query.exec(CREATE_COMMENT_TABLE));
+
+    QList<BlogObject> blogs;
+    for (int i = 0; i < BATCH_COUNT; ++i) {
+        BlogObject blog;
+        blog.title = "Batch";
+        blog.body = QString::number(i);
+        blogs << blog;
+    }
+
+    TSqlORMapper<BlogObject> mapper;
+    QVariantList ids;
+    QCOMPARE(mapper.insertAll(blogs, &ids), BATCH_COUNT);
+
+    QList<CommentObject> comments;
+    for (int i = 0; i < ids.count(); ++i) {
+        for (int j = 0; j < 2; ++j) {
+            CommentObject comment;
+            comment.blog_id = ids[i].toInt();
+            comment.body = QString::number(j);
+            comments << comment;
+        }
+    }
+    TSqlORMapper<CommentObject> commentMapper;
+    QCOMPARE(commentMapper.insertAll(comments), BATCH_COUNT * 2);
+
+    TCriteria cri(BlogObject::Title, QString("Batch"));
+    mapper.includeHasMany<CommentObject>(CommentObject::BlogId);
+    QCOMPARE(mapper.find(cri), BATCH_COUNT);
+
+    int cnt = 0;
+    TSqlORMapperIterator<BlogObject> it(mapper);
+    while (it.hasNext()) {
+        QList<CommentObject> list = mapper.hasMany<CommentObject>(it.next(), CommentObject::BlogId);
+        QCOMPARE(list.count(), 2);
+        cnt += list.count();
+    }
+    QCOMPARE(cnt, BATCH_COUNT * 2);
+
+    QBENCHMARK {
+        QCOMPARE(mapper.find(cri), BATCH_COUNT);
+    }
+}
+
+
+void OrmBenchmark::poolPopPush()
+{
+    TSqlDatabasePool *pool = TSqlDatabasePool::instance();
+    QBENCHMARK {
+        QSqlDatabase db = pool->pop(0);
+        QVERIFY(db.isOpen());
+        pool->push(db);
+        QVERIFY(!db.isValid());
+    }
+    QCOMPARE(pool->waitCount(), (quint64)0);
+}
+
+
+/*
+  Threads pop and push connections concurrently, as many as the pool
+  has besides the one held by this thread, so that none waits.
+*/
+void OrmBenchmark::poolChurn()
+{
+    class ChurnThread : public QThread {
+    public:
+        ChurnThread() : failures(0) { }
+        int failures;
+    protected:
+        virtual void run()
+        {
+            TSqlDatabasePool *pool = TSqlDatabasePool::instance();
+            for (int i = 0; i < CHURN_COUNT; ++i) {
+                QSqlDatabase db = pool->pop(0);
+                if (!db.isOpen()) {
+                    ++failures;
+                }
+                pool->push(db);
+            }
+        }
+    };
+
+    int threadCount = qMax(Tf::app()->maxNumberOfServers() - 1, 1);
+    quint64 waits = TSqlDatabasePool::instance()->waitCount();
+
+    QBENCHMARK {
+        QList<ChurnThread *> threads;
+        for (int i = 0; i < threadCount; ++i) {
+            threads << new ChurnThread;
+            threads.last()->start();
+        }
+        for (int i = 0; i < threads.count(); ++i) {
+            threads[i]->wait();
+            QCOMPARE(threads[i]->failures, 0);
+            delete threads[i];
+        }
+    }
+    QCOMPARE(TSqlDatabasePool::instance()->waitCount(), waits);
+}
+
+
+void OrmBenchmark::resultCache()
+{
+    startOver();
+    TSqlORMapper<BlogObject> mapper;
+    mapper.setResultCache(true);
+    BlogObject blog = mapper.findByPrimaryKey(insertedId);
+    QCOMPARE(blog.id, insertedId);
+
+    quint64 hits = TSqlResultCache::hitCount();
+    QCOMPARE(mapper.findByPrimaryKey(insertedId).title, blog.title);
+    QCOMPARE(TSqlResultCache::hitCount(), hits + 1);
+
+    // Invalidated by the update
+    blog.title = "Cached";
+    QVERIFY(blog.update());
+    QCOMPARE(mapper.findByPrimaryKey(insertedId).title, QString("Cached"));
+
+    int count = mapper.find(TCriteria(BlogObject::Title, QString("Cached")));
+    QCOMPARE(count, 1);
+    QCOMPARE(mapper.find(TCriteria(BlogObject::Title, QString("Cached"))), count);
+    QCOMPARE(mapper.first().id, insertedId);
+
+    // Invalidated by a write to the joined table
+    startOver();
+    TSqlQueryORMapper<BlogObject> joined("SELECT blog.* FROM blog JOIN comment ON comment.blog_id = blog.id WHERE comment.body = ?");
+    joined.setResultCache(true, 0, QStringList("comment")).addBind(QString("Joined"));
+    QVERIFY(joined.findFirst().isNull());
+    hits = TSqlResultCache::hitCount();
+    QVERIFY(joined.findFirst().isNull());
+    QCOMPARE(TSqlResultCache::hitCount(), hits + 1);
+
+    CommentObject comment;
+    comment.blog_id = insertedId;
+    comment.body = "Joined";
+    QVERIFY(comment.create());
+    startOver();
+    QCOMPARE(joined.findFirst().id, insertedId);
+
+    QBENCHMARK {
+        QCOMPARE(mapper.findByPrimaryKey(insertedId).id, insertedId);
+    }
+}
+
+
+void OrmBenchmark::queryStatistics()
+{
+    QCOMPARE(TSqlQueryStatistics::shapeOf("SELECT * FROM blog  WHERE id=12 AND title='it''s'"),
+             QString("SELECT * FROM blog WHERE id=? AND title=?"));
+    QCOMPARE(TSqlQueryStatistics::shapeOf("SELECT * FROM t2 WHERE id IN (1, 2, 3)"),
+             QString("SELECT * FROM t2 WHERE id IN (?)"));
+    QCOMPARE(TSqlQueryStatistics::shapeOf("INSERT INTO blog (title) VALUES (?), (?), (?)"),
+             QString("INSERT INTO blog (title) VALUES (?)"));
+
+    TSqlQuery query;
+    QString shape = TSqlQueryStatistics::shapeOf("SELECT COUNT(*) FROM blog WHERE id=0");
+    quint64 cnt = TSqlQueryStatistics::count(shape);
+    QVERIFY(query.exec("SELECT COUNT(*) FROM blog WHERE id=" + QString::number(insertedId)));
+    QVERIFY(query.exec("SELECT COUNT(*) FROM blog WHERE id=0"));
+    QCOMPARE(TSqlQueryStatistics::count(shape), cnt + 2);
+
+    quint64 sum = 0;
+    QVector<quint64> hist = TSqlQueryStatistics::histogram(shape);
+    for (int i = 0; i < hist.count(); ++i) {
+        sum += hist[i];
+    }
+    QCOMPARE(sum, cnt + 2);
+
+    QBENCHMARK {
+        TSqlQueryStatistics::shapeOf("SELECT * FROM blog WHERE id=12 AND title='Hello' ORDER BY id LIMIT 20");
+    }
+}
+
+
+void OrmBenchmark::statementsPerSecond()
+{
+    QElapsedTimer timer;
+    BlogObject blog;
+    blog.title = "Hello";
+    blog.body = "Hello world";
+
+    timer.start();
+    for (int i = 0; i < STATEMENT_COUNT; ++i) {
+        execLiteralInsert(blog);
+        execLiteralFind(insertedId);
+    }
+    qint64 literalMsecs = qMax(timer.elapsed(), (qint64)1);
+
+    TSqlORMapper<BlogObject> mapper;
+    timer.restart();
+    for (int i = 0; i < STATEMENT_COUNT; ++i) {
+        BlogObject obj;
+        obj.title = "Hello";
+        obj.body = "Hello world";
+        obj.create();
+        mapper.findByPrimaryKey(insertedId);
+    }
+    qint64 preparedMsecs = qMax(timer.elapsed(), (qint64)1);
+
+    qDebug("literal statements:  %lld stmts/sec", STATEMENT_COUNT * 2 * 1000LL / literalMsecs);
+    qDebug("prepared statements: %lld stmts/sec", STATEMENT_COUNT * 2 * 1000LL / preparedMsecs);
+    qDebug("statement cache hits: %llu  misses: %llu", TSqlStatementCache::hitCount(), TSqlStatementCache::missCount());
+    QVERIFY(TSqlStatementCache::hitCount() > 0);
+}
+
+/*
+  The replica is another SQLite file, which is not synchronized with
+  the primary, so that the rows show which database is read.
+*/
+void OrmBenchmark::readFromReplica()
+{
+    if (inMemory()) {
+        SKIP("No replica of the in-memory database");
+    }
+
+    QSqlDatabase replica = TSqlDatabasePool::instance()->popReplica(0);
+    QVERIFY(replica.isValid());
+    {
+        QSqlQuery query(replica);
+        QVERIFY(query.exec("DROP TABLE IF EXISTS blog"));
+        QVERIFY(query.exec(CREATE_BLOG_TABLE));
+        QVERIFY(query.exec("INSERT INTO blog (title, body, lock_revision) VALUES ('Replica', 'Hello', 1)"));
+    }
+    TSqlDatabasePool::instance()->push(replica);
+
+    // Starts over as a request which has not written yet
+    TActionContext::current()->releaseDatabases();
+
+    TSqlORMapper<BlogObject> mapper;
+    TCriteria cri(BlogObject::Title, QString("Replica"));
+    QCOMPARE(mapper.findCount(cri), 1);
+
+    QBENCHMARK {
+        QCOMPARE(mapper.findFirst(cri).title, QString("Replica"));
+    }
+
+    // Reads after a write go to the primary
+    TSqlQuery query;
+    QVERIFY(query.exec("DROP TABLE IF EXISTS blog"));
+    QVERIFY(query.exec(CREATE_BLOG_TABLE));
+    QCOMPARE(mapper.findCount(cri), 0);
+    QCOMPARE(mapper.find(cri), 0);
+}
+
+
+void OrmBenchmark::findAsync()
+{
+    if (inMemory()) {
+        SKIP("Another connection opens another in-memory database");
+    }
+
+    // Executed on the replica, which readFromReplica() populated
+    TCriteria cri(BlogObject::Title, QString("Replica"));
+    TSqlORMapper<BlogObject> mapper;
+    TSqlORMapperFuture<BlogObject> future = mapper.findAsync(cri);
+    QFuture<QList<QSqlRecord> > count = TSqlAsyncQuery::exec("SELECT COUNT(*) FROM blog WHERE title=?", QVariantList() << "Replica");
+    QCOMPARE(future.results().count(), 1);
+    QCOMPARE(future.first().title, QString("Replica"));
+    QCOMPARE(count.result().value(0).value(0).toInt(), 1);
+
+    QBENCHMARK {
+        QList<TSqlORMapperFuture<BlogObject> > futures;
+        for (int i = 0; i < 5; ++i) {
+            futures << mapper.findAsync(cri);
+        }
+        for (int i = 0; i < futures.count(); ++i) {
+            QCOMPARE(futures[i].count(), 1);
+        }
+    }
+}
+
+
+/*
+  The entries are distributed by the user id over the test database and
+  its shard, which is another SQLite file; odd users go to the shard.
+*/
+void OrmBenchmark::shardByKey()
+{
+    TSqlDatabasePool *pool = TSqlDatabasePool::instance();
+    QCOMPARE(pool->shardCount(0), 2);
+    for (int s = 0; s < pool->shardCount(0); ++s) {
+        QSqlQuery query(TActionContext::current()->getDatabase(pool->shardDatabaseId(0, s)));
+        QVERIFY(query.exec("DROP TABLE IF EXISTS entry"));
+        QVERIFY(query.exec(CREATE_ENTRY_TABLE));
+    }
+
+    QList<EntryObject> entries;
+    for (int i = 0; i < 100; ++i) {
+        EntryObject entry;
+        entry.id = i + 1;
+        entry.user_id = i % 10;
+        entry.title = QString::number(i);
+        entries << entry;
+    }
+
+    TSqlORMapper<EntryObject> mapper;
+    QCOMPARE(mapper.insertAll(entries), 100);
+    QCOMPARE(mapper.findCount(), 100);
+    QCOMPARE(mapper.findCount(TCriteria(EntryObject::UserId, 3)), 10);
+
+    QSqlQuery query(TActionContext::current()->getDatabase(pool->shardDatabaseId(0, 1)));
+    QVERIFY(query.exec("SELECT COUNT(*) FROM entry") && query.next());
+    QCOMPARE(query.value(0).toInt(), 50);
+
+    // Merged in the sort order over the shards
+    mapper.setSortOrder(EntryObject::Id, TSql::DescendingOrder);
+    mapper.setLimit(10);
+    mapper.setOffset(5);
+    QCOMPARE(mapper.find(), 10);
+    QCOMPARE(mapper.first().id, 95);
+    QCOMPARE(mapper.last().id, 86);
+
+    EntryObject entry;
+    entry.id = 101;
+    entry.user_id = 7;
+    entry.title = "Created";
+    QVERIFY(entry.create());
+
+    TSqlORMapper<EntryObject> finder;
+    QCOMPARE(finder.findFirst(TCriteria(EntryObject::Title, QString("Created"))).user_id, 7);
+
+    QBENCHMARK {
+        QCOMPARE(finder.findCount(TCriteria(EntryObject::UserId, 7)), 11);
+    }
+}
+
+
+void OrmBenchmark::upsert()
+{
+    TSqlORMapper<EntryObject> mapper;
+    TCriteria cri(EntryObject::UserId, 7);
+    int cnt = mapper.findCount(cri);
+
+    EntryObject entry;
+    entry.id = 101;
+    entry.user_id = 7;
+    entry.title = "Upserted";
+    QVERIFY(entry.upsert());
+    QCOMPARE(mapper.findCount(cri), cnt);
+    QCOMPARE(mapper.findByPrimaryKey(101).title, QString("Upserted"));
+
+    EntryObject created;
+    created.id = 102;
+    created.user_id = 7;
+    created.title = "Created";
+    QVERIFY(created.upsert());
+    QCOMPARE(mapper.findCount(cri), cnt + 1);
+    QCOMPARE(mapper.findByPrimaryKey(102).title, QString("Created"));
+
+    QBENCHMARK {
+        QVERIFY(entry.upsert());
+    }
+}
+
+
+/*
+  The session store writes by TSqlObject::upsert(), which updates and
+  inserts on SQLite older than 3.24, e.g. bundled with Qt 4.
+*/
+void OrmBenchmark::storeSession()
+{
+    TSqlQuery query;
+    QVERIFY(query.exec("DROP TABLE IF EXISTS session"));
+    QVERIFY(query.exec(CREATE_SESSION_TABLE));
+
+    QScopedPointer<TSessionStore> store(TSessionStoreFactory::create("sqlobject"));
+    QVERIFY(!store.isNull());
+    TSession session("0123456789abcdef");
+    session.insert("name", "first");
+    QVERIFY(store->store(session));
+    session.insert("name", "second");
+    QVERIFY(store->store(session));
+
+    QDateTime modified = QDateTime::currentDateTime().addSecs(-60);
+    QCOMPARE(store->find(session.id(), modified).value("name").toString(), QString("second"));
+    QVERIFY(query.exec("SELECT COUNT(*) FROM session"));
+    QCOMPARE(query.getNextValue().toInt(), 1);
+
+    QBENCHMARK {
+        QVERIFY(store->store(session));
+    }
+}
+
+
+/*
+  The query file is prepared once per connection, and read again
+  after it is modified. The queries loaded at the same time do not
+  share the prepared statement.
+*/
+void OrmBenchmark::loadQueryFile()
+{
+    TSqlQuery query;
+    QDir dir(query.queryDirPath());
+    QVERIFY(dir.mkpath("."));
+    QFile file(dir.filePath("countblog.sql"));
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write("SELECT COUNT(*) FROM blog");
+    file.close();
+
+    QVERIFY(query.load("countblog.sql"));
+    QVERIFY(query.exec());
+    QVERIFY(query.getNextValue().toInt() >= 0);
+    query.finish();
+
+    // Not shared until the first one is finished
+    TSqlQuery first, second;
+    QVERIFY(first.load("countblog.sql"));
+    QVERIFY(second.load("countblog.sql"));
+    QVERIFY(second.result() != first.result());
+    first.finish();
+    second.finish();
+
+    quint64 hits = TSqlStatementCache::hitCount();
+    QBENCHMARK {
+        TSqlQuery q;
+        QVERIFY(q.load("countblog.sql"));
+        QVERIFY(q.exec());
+    }
+    QVERIFY(TSqlStatementCache::hitCount() > hits);
+
+    // Modified a second later, which the file time can tell
+    Tf::msleep(1100);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write("SELECT 12345");
+    file.close();
+    TSqlQuery modified;
+    QVERIFY(modified.load("countblog.sql"));
+    QVERIFY(modified.exec());
+    QCOMPARE(modified.getNextValue().toInt(), 12345);
+}
+
+
+int main(int argc, char *argv[])
+{
+    class Thread : public TActionThread {
+    public:
+        Thread(const QStringList &args) : TActionThread(0), returnCode(0), arguments(args) { }
+        int returnCode;
+        QStringList arguments;
+    protected:
+        virtual void run()
+        {
+            OrmBenchmark obj;
+            returnCode = QTest::qExec(&obj, arguments);
+        }
+    };
+
+    // The web root is the directory of this test, containing 'config'
+    QDir::setCurrent(QFileInfo(argv[0]).absolutePath());
+    TWebApplication app(argc, argv);
+
+    // '-memory' runs on the in-memory database instead of the files
+    QStringList args = QCoreApplication::arguments();
+    bool memory = args.removeAll("-memory") > 0;
+    app.setDatabaseEnvironment((memory) ? "memory" : "test");
+    TSqlDatabasePool::instantiate();
+    Thread thread(args);
+    thread.start();
+    thread.wait();
+    return thread.returnCode;
+}
+
+#include "main.moc"
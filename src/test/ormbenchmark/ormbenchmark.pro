@@ -0,0 +1,25 @@
+TARGET = ormbenchmark
+TEMPLATE = app
+CONFIG += console release qtestlib
+CONFIG -= debug
+CONFIG -= app_bundle
+QT += network sql
+QT -= gui
+INCLUDEPATH += ../../../include ../..
+HEADERS += blogobject.h entryobject.h commentobject.h
+SOURCES += main.cpp
+include(../../../tfbase.pri)
+
+
+win32 {
+  CONFIG(debug, debug|release) {
+    TARGET = $$join(TARGET,,,d)
+    LIBS += -L "..\\..\\debug" -ltreefrogd$${TF_VER_MAJ}
+  } else {
+    LIBS += -L "..\\..\\release" -ltreefrog$${TF_VER_MAJ}
+  }
+} else:macx {
+  LIBS += -F../../ -framework treefrog
+} else:unix {
+  LIBS += -L../../ -ltreefrog
+}
@@ -1,3 +1,3 @@
 TEMPLATE=subdirs
-SUBDIRS=htmlescape httpheader hmac sharedmemorylogstream htmlparser mailmessage  multipartformdata  smtpmailer viewhelper
+SUBDIRS=htmlescape httpheader hmac sharedmemorylogstream htmlparser mailmessage  multipartformdata  smtpmailer viewhelper cache chunkeddevice ormbenchmark
 
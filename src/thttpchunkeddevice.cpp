@@ -0,0 +1,117 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QAbstractSocket>
+#include "thttpchunkeddevice.h"
+#include "tsystemglobal.h"
+
+const qint64 MAX_BYTES_TO_WRITE = 64 * 1024;
+const int WRITE_TIMEOUT_MSECS = 30000;
+
+/*!
+  \class THttpChunkedDevice
+  \brief The THttpChunkedDevice class writes a HTTP response body to
+  the socket as it is generated, using the chunked transfer coding.
+  Internal use only.
+
+  The data written is sent immediately; when the output device has more
+  than a fixed amount of data pending, writing blocks until the data is
+  sent, so that the memory used does not depend on the size of the
+  body. If the chunked coding is disabled, for HTTP/1.0 clients, the
+  data is written as it is and the end of the body is indicated by
+  closing the connection.
+*/
+
+THttpChunkedDevice::THttpChunkedDevice(QIODevice *device, bool chunked)
+    : QIODevice(), outDevice(device), chunkedEncoding(chunked), sentBytes(0)
+{ }
+
+
+THttpChunkedDevice::~THttpChunkedDevice()
+{
+    close();
+}
+
+/*!
+  Writes the last chunk and closes the device.
+*/
+void THttpChunkedDevice::close()
+{
+    if (!isOpen())
+        return;
+
+    if (chunkedEncoding) {
+        static const char lastChunk[] = "0\r\n\r\n";
+        if (writeRaw(lastChunk, sizeof(lastChunk) - 1)) {
+            sentBytes += sizeof(lastChunk) - 1;
+        }
+    }
+
+    QAbstractSocket *socket = qobject_cast<QAbstractSocket *>(outDevice);
+    if (socket) {
+        socket->flush();
+    }
+    QIODevice::close();
+}
+
+
+qint64 THttpChunkedDevice::readData(char *, qint64)
+{
+    return -1;
+}
+
+
+qint64 THttpChunkedDevice::writeData(const char *data, qint64 size)
+{
+    if (size <= 0)
+        return 0;  // an empty chunk would terminate the body
+
+    if (chunkedEncoding) {
+        QByteArray head = QByteArray::number(size, 16) + "\r\n";
+        if (!writeRaw(head.constData(), head.length()))
+            return -1;
+        sentBytes += head.length();
+    }
+
+    if (!writeRaw(data, size))
+        return -1;
+    sentBytes += size;
+
+    if (chunkedEncoding) {
+        if (!writeRaw("\r\n", 2))
+            return -1;
+        sentBytes += 2;
+    }
+
+    // Sends the data now and bounds the data pending in the device
+    QAbstractSocket *socket = qobject_cast<QAbstractSocket *>(outDevice);
+    if (socket) {
+        socket->flush();
+    }
+    while (outDevice->bytesToWrite() > MAX_BYTES_TO_WRITE) {
+        if (!outDevice->waitForBytesWritten(WRITE_TIMEOUT_MSECS)) {
+            tWarn("write error: waitForBytesWritten function [%s]", qPrintable(outDevice->errorString()));
+            return -1;
+        }
+    }
+    return size;
+}
+
+
+bool THttpChunkedDevice::writeRaw(const char *data, qint64 size)
+{
+    qint64 total = 0;
+    while (total < size) {
+        qint64 written = outDevice->write(data + total, size - total);
+        if (written <= 0) {
+            tWarn("write error: total:%d (%d)", (int)total, (int)written);
+            return false;
+        }
+        total += written;
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef THTTPCHUNKEDDEVICE_H
+#define THTTPCHUNKEDDEVICE_H
+
+#include <QIODevice>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT THttpChunkedDevice : public QIODevice
+{
+public:
+    THttpChunkedDevice(QIODevice *device, bool chunked = true);
+    ~THttpChunkedDevice();
+
+    void close();
+    bool isSequential() const { return true; }
+    qint64 bytesSent() const { return sentBytes; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 size);
+
+private:
+    Q_DISABLE_COPY(THttpChunkedDevice)
+
+    bool writeRaw(const char *data, qint64 size);
+
+    QIODevice *outDevice;
+    bool chunkedEncoding;
+    qint64 sentBytes;
+};
+
+#endif // THTTPCHUNKEDDEVICE_H
@@ -2,30 +2,58 @@
 #define TLAZYLOADER_H
 
 #include <TGlobal>
+#include <TSqlORMapper>
 
+/*!
+  \class TLazyLoader
+  \brief The TLazyLoader class is a template class that defers the
+  retrieval of an ORM object of the class \a T until it is accessed.
+
+  A subclass sets the primary key by setLazyLoadKey() and calls
+  loadObject() before accessing the object returned by lazyObject().
+  The object is retrieved at most once.
+*/
 
 template <typename T, typename Key>
-class TLazyLoader {
+class TLazyLoader
+{
+public:
+    TLazyLoader() : pkey(), loaded(true) { }
+    virtual ~TLazyLoader() { }
+
 protected:
-    void setLazyLoadKey(const Key &pk) { pkey = pk; }
+    void setLazyLoadKey(const Key &pk);
+    bool isLoaded() const { return loaded; }
     void loadObject();
     virtual T *lazyObject() = 0;
 
 private:
     Key pkey;
+    bool loaded;
 };
 
+/*!
+  Sets the primary key of the object to retrieve later to \a pk.
+*/
+template <typename T, typename Key>
+inline void TLazyLoader<T, Key>::setLazyLoadKey(const Key &pk)
+{
+    pkey = pk;
+    loaded = false;
+}
 
+/*!
+  Retrieves the object with the primary key set by setLazyLoadKey()
+  into lazyObject(), if not retrieved yet.
+*/
 template <typename T, typename Key>
 inline void TLazyLoader<T, Key>::loadObject()
 {
-    T_TRACEFUNC();
-    if (lazyObject()->isEmpty()) {
+    T_TRACEFUNC("");
+    if (!loaded) {
+        loaded = true;
         TSqlORMapper<T> mapper;
-        //*lazyObject() = mapper.findByPrimaryKey(pkey);
-
-        abort();
-        // ここは実装しなおし、QSharedDataPointer を参考に！
+        *lazyObject() = mapper.findByPrimaryKey(QVariant(pkey));
     }
 }
 
@@ -19,20 +19,18 @@
 
 /* create table session ( id varchar(50) primary key, data blob, updated_at datetime ); */
 
+/*!
+  Stores the session \a session by one upsert statement, without
+  looking it up first.
+  \sa TSqlObject::upsert()
+*/
 bool TSessionSqlObjectStore::store(TSession &session)
 {
-    TSqlORMapper<TSessionObject> mapper;
-    TCriteria cri(TSessionObject::Id, TSql::Equal, session.id());
-    TSessionObject so = mapper.findFirst(cri);
-
+    TSessionObject so;
+    so.id = session.id();
     QDataStream ds(&so.data, QIODevice::WriteOnly);
     ds << *static_cast<const QVariantHash *>(&session);
-
-    if (so.isEmpty()) {
-        so.id = session.id();
-        return so.create();
-    }
-    return so.update();
+    return so.upsert();
 }
 
 
@@ -0,0 +1,153 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QMutexLocker>
+#include <TSqlAsyncQuery>
+#include <TSqlDatabasePool>
+#include <TSqlStatementCache>
+#include <TWebApplication>
+#include "tsystemglobal.h"
+
+#define MAX_THREADS_KEY  "SqlAsyncQuery.MaxThreads"
+
+/*!
+  \class TSqlAsyncQuery
+  \brief The TSqlAsyncQuery class executes SELECT statements in the
+  background on the pooled database connections.
+
+  The independent queries of an action can be submitted together and
+  run concurrently on several connections, so that the action waits for
+  the slowest one instead of the sum of them:
+  \code
+  QFuture<QList<QSqlRecord> > count = TSqlAsyncQuery::exec("SELECT COUNT(*) FROM blog");
+  TSqlORMapperFuture<CategoryObject> categories = categoryMapper.findAsync();
+  ...
+  int n = count.result().value(0).value(0).toInt();
+  \endcode
+  A query is executed on a connection of a replica database if any,
+  otherwise of the primary database, outside the transaction of the
+  action; it does not see the rows written by the action. Only the
+  statements which do not modify the database may be executed.
+  The database pool keeps maxThreadCount() connections of each database
+  in addition to those of the actions for the queries.
+  \sa TSqlORMapper::findAsync(), TSqlORMapperFuture
+*/
+
+
+class TSqlAsyncQueryTask : public QRunnable
+{
+public:
+    TSqlAsyncQueryTask(const QString &query, const QVariantList &values, int databaseId)
+        : QRunnable(), query(query), values(values), databaseId(databaseId) { }
+
+    QFuture<QList<QSqlRecord> > start(QThreadPool *pool)
+    {
+        futureInterface.reportStarted();
+        QFuture<QList<QSqlRecord> > future = futureInterface.future();
+        pool->start(this);
+        return future;
+    }
+
+protected:
+    void run()
+    {
+        QList<QSqlRecord> records;
+        bool ok = TSqlAsyncQuery::run(query, values, databaseId, records);
+        futureInterface.reportResult(records);
+        if (!ok) {
+            futureInterface.reportCanceled();
+        }
+        futureInterface.reportFinished();
+    }
+
+private:
+    QString query;
+    QVariantList values;
+    int databaseId;
+    QFutureInterface<QList<QSqlRecord> > futureInterface;
+};
+
+/*!
+  Executes the SQL statement \a query with the bound values \a values
+  on a connection of the database \a databaseId in the background, and
+  returns the future of the rows retrieved. If an error occurred, the
+  future is canceled and the result is an empty list.
+*/
+QFuture<QList<QSqlRecord> > TSqlAsyncQuery::exec(const QString &query, const QVariantList &values, int databaseId)
+{
+    TSqlAsyncQueryTask *task = new TSqlAsyncQueryTask(query, values, databaseId);
+    return task->start(threadPool());
+}
+
+/*!
+  Returns the thread pool which executes the queries.
+  \sa maxThreadCount()
+*/
+QThreadPool *TSqlAsyncQuery::threadPool()
+{
+    static QThreadPool *pool = 0;
+    static QMutex mutex;
+
+    QMutexLocker locker(&mutex);
+    if (!pool) {
+        pool = new QThreadPool;
+        pool->setMaxThreadCount(maxThreadCount());
+    }
+    return pool;
+}
+
+/*!
+  Returns the maximum number of the threads executing the queries, which
+  is indicated by the value for application setting
+  \a SqlAsyncQuery.MaxThreads.
+*/
+int TSqlAsyncQuery::maxThreadCount()
+{
+    static int maxThreads = qMax(Tf::app()->appSettings().value(MAX_THREADS_KEY, 4).toInt(), 1);
+    return maxThreads;
+}
+
+/*!
+  Executes the SQL statement \a query in the current thread, and sets
+  the rows retrieved to \a records. Returns true if the query executed
+  successfully; otherwise returns false.
+  This function is for internal use only.
+*/
+bool TSqlAsyncQuery::run(const QString &query, const QVariantList &values, int databaseId, QList<QSqlRecord> &records)
+{
+    TSqlDatabasePool *dbpool = TSqlDatabasePool::instance();
+    QSqlDatabase db;
+
+    try {
+        db = dbpool->popReplica(databaseId);
+        if (!db.isValid()) {
+            db = dbpool->pop(databaseId);
+        }
+    } catch (RuntimeException &e) {
+        tSystemError("Asynchronous query failed: %s  [%s]", qPrintable(e.message()), qPrintable(query));
+        return false;
+    }
+
+    bool ok;
+    QSqlQuery sqlQuery = TSqlStatementCache::prepare(db, query, &ok);
+    if (ok && TSqlStatementCache::exec(sqlQuery, values)) {
+        while (sqlQuery.next()) {
+            records << sqlQuery.record();
+        }
+    } else {
+        tSystemError("Asynchronous query failed: %s  [%s]", qPrintable(sqlQuery.lastError().text()), qPrintable(query));
+        ok = false;
+    }
+    sqlQuery.finish();
+    sqlQuery = QSqlQuery();
+    dbpool->push(db);
+    return ok;
+}
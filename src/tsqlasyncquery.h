@@ -0,0 +1,27 @@
+#ifndef TSQLASYNCQUERY_H
+#define TSQLASYNCQUERY_H
+
+#include <QFuture>
+#include <QList>
+#include <QSqlRecord>
+#include <QVariant>
+#include <TGlobal>
+
+class QThreadPool;
+
+
+class T_CORE_EXPORT TSqlAsyncQuery
+{
+public:
+    static QFuture<QList<QSqlRecord> > exec(const QString &query, const QVariantList &values = QVariantList(), int databaseId = 0);
+    static QThreadPool *threadPool();
+    static int maxThreadCount();
+
+private:
+    static bool run(const QString &query, const QVariantList &values, int databaseId, QList<QSqlRecord> &records);
+    TSqlAsyncQuery();
+
+    friend class TSqlAsyncQueryTask;
+};
+
+#endif // TSQLASYNCQUERY_H
@@ -5,13 +5,50 @@
  * the New BSD License, which is incorporated herein by reference.
  */
 
+#include <QAtomicInt>
 #include <QMutexLocker>
 #include <QFileInfo>
 #include <QDir>
+#include <QSqlQuery>
 #include <TSqlDatabasePool>
+#include <TSqlStatementCache>
+#include <TSqlAsyncQuery>
 #include <TWebApplication>
 #include "tsystemglobal.h"
 
+#define REPLICA_GROUP_SUFFIX  ".replica"
+#define REPLICA_BALANCING_KEY  "ReplicaBalancing"
+#define REPLICA_RETRY_INTERVAL  30
+#define SHARD_GROUP_SUFFIX  ".shard"
+#define MIN_IDLE_KEY  "SqlDatabasePool.MinIdle"
+#define MAX_IDLE_KEY  "SqlDatabasePool.MaxIdle"
+#define IDLE_TIMEOUT_KEY  "SqlDatabasePool.IdleTimeout"
+#define VALIDATION_INTERVAL_KEY  "SqlDatabasePool.ValidationInterval"
+#define WAIT_TIMEOUT_KEY  "SqlDatabasePool.WaitTimeout"
+
+/*!
+  \class TSqlDatabasePool
+  \brief The TSqlDatabasePool class pools the database connections of
+  the application server.
+
+  The connections to a database, or to a replica of it, are fixed slots
+  kept in a lock-free LIFO free list, so that pop() and push() do not
+  contend on a mutex and the most recently used connection, warm with
+  prepared statements, is reused first. A timer keeps between
+  \a SqlDatabasePool.MinIdle and \a SqlDatabasePool.MaxIdle idle
+  connections open, closing the ones idle longer than
+  \a SqlDatabasePool.IdleTimeout seconds and opening new ones in
+  advance. A connection idle longer than
+  \a SqlDatabasePool.ValidationInterval seconds is validated before
+  it is returned.
+
+  The rows of a sharded model are distributed over the database and its
+  shards, [env.shard1], [env.shard2], .. in the database settings. Each
+  shard is pooled as a virtual database, whose ID follows the IDs of the
+  database settings, and shardDatabaseId() maps a shard number to it.
+  Shards do not have replicas.
+*/
+
 static TSqlDatabasePool *databasePool = 0;
 
 
@@ -24,36 +61,103 @@ static void cleanup()
 }
 
 
+static QString connectionName(int databaseId, int replica, int index)
+{
+    return (replica < 0) ? QString().sprintf("%02d_%d", databaseId, index)
+        : QString().sprintf("%02d_r%d_%d", databaseId, replica + 1, index);
+}
+
+
+struct TSqlDatabasePool::ConnectionGroup
+{
+    ConnectionGroup(const QString &env, int id, int rep, int settings)
+        : environment(env), databaseId(id), replica(rep), settingsId(settings), freeHead(0), activeCount(0), retryTime(0), counter(0), maintaining(0)
+    { }
+
+    bool popFree(int &index);
+    void pushFree(int index);
+
+    QString environment;
+    int databaseId;
+    int replica;   // -1 for the primary database
+    int settingsId;  // index of the database settings
+    QVector<QSqlDatabase> connections;
+    QVector<int> lastUsed;
+    QVector<int> nextFree;
+    QAtomicInt freeHead;     // ABA tag in the upper 16 bits, index + 1 in the lower
+    QAtomicInt activeCount;
+    QAtomicInt retryTime;
+    QAtomicInt counter;      // round-robin counter of the replicas
+    QAtomicInt maintaining;  // number of free connections held by maintain()
+};
+
+
+bool TSqlDatabasePool::ConnectionGroup::popFree(int &index)
+{
+    for (;;) {
+        int head = freeHead.fetchAndAddRelaxed(0);
+        int idx = (head & 0xFFFF) - 1;
+        if (idx < 0) {
+            return false;
+        }
+
+        int newHead = (int)(((uint)head & 0xFFFF0000u) + 0x10000u) | ((nextFree[idx] + 1) & 0xFFFF);
+        if (freeHead.testAndSetOrdered(head, newHead)) {
+            index = idx;
+            return true;
+        }
+    }
+}
+
+
+void TSqlDatabasePool::ConnectionGroup::pushFree(int index)
+{
+    for (;;) {
+        int head = freeHead.fetchAndAddRelaxed(0);
+        nextFree[index] = (head & 0xFFFF) - 1;
+
+        int newHead = (int)(((uint)head & 0xFFFF0000u) + 0x10000u) | ((index + 1) & 0xFFFF);
+        if (freeHead.testAndSetOrdered(head, newHead)) {
+            return;
+        }
+    }
+}
+
+
 TSqlDatabasePool::~TSqlDatabasePool()
 {
     timer.stop();
 
-    QMutexLocker locker(&mutex);
-    for (int j = 0; j < pooledConnections.count(); ++j) {
-        QMap<QString, QDateTime> &map = pooledConnections[j];
-        QMap<QString, QDateTime>::iterator it = map.begin();
-        while (it != map.end()) {
-            QSqlDatabase::database(it.key(), false).close();
-            it = map.erase(it);
-        }
-        
-        for (int i = 0; i < maxConnections; ++i) {
-            QString name = QString::number(j) + '_' + QString::number(i);
-            if (QSqlDatabase::contains(name)) {
-                QSqlDatabase::removeDatabase(name);
-            } else {
-                break;
-            }
+    QList<ConnectionGroup *> groups = primaries.toList();
+    for (int j = 0; j < replicas.count(); ++j) {
+        groups << replicas[j].toList();
+    }
+
+    for (int j = 0; j < groups.count(); ++j) {
+        ConnectionGroup *grp = groups[j];
+        QStringList names;
+        for (int i = 0; i < grp->connections.count(); ++i) {
+            QSqlDatabase &db = grp->connections[i];
+            names << db.connectionName();
+            TSqlStatementCache::clear(db.connectionName());
+            db.close();
+        }
+        delete grp;
+
+        for (int i = 0; i < names.count(); ++i) {
+            QSqlDatabase::removeDatabase(names[i]);
         }
     }
 }
 
 
 TSqlDatabasePool::TSqlDatabasePool(const QString &environment)
-    : QObject(), maxConnections(0), dbEnvironment(environment)
+    : QObject(), maxConnections(0), minIdle(0), maxIdle(0), idleTimeout(30), validationInterval(10),
+      waitTimeout(0), dbEnvironment(environment), waits(0), totalWaitMsecs(0), maxWaitMsecs(0)
 {
-    // Starts the timer to close extra-connection
-    timer.start(10000, this); 
+    clock.start();
+    // Starts the timer to maintain idle connections
+    timer.start(10000, this);
 }
 
 
@@ -61,67 +165,374 @@ void TSqlDatabasePool::init()
 {
     // Adds databases previously
     maxConnections = (Tf::app()->multiProcessingModule() == TWebApplication::Thread) ? Tf::app()->maxNumberOfServers() : 1;
+    // Reserves the connections for the asynchronous queries
+    maxConnections += TSqlAsyncQuery::maxThreadCount();
+
+    QSettings &appSettings = Tf::app()->appSettings();
+    minIdle = qBound(0, appSettings.value(MIN_IDLE_KEY, 0).toInt(), maxConnections);
+    QString max = appSettings.value(MAX_IDLE_KEY).toString().trimmed();
+    maxIdle = (max.isEmpty()) ? maxConnections : qBound(minIdle, max.toInt(), maxConnections);
+    idleTimeout = appSettings.value(IDLE_TIMEOUT_KEY, 30).toInt();
+    validationInterval = appSettings.value(VALIDATION_INTERVAL_KEY, 10).toInt();
+    waitTimeout = appSettings.value(WAIT_TIMEOUT_KEY, 0).toInt();
 
     for (int j = 0; j < Tf::app()->databaseSettingsCount(); ++j) {
         QString type = driverType(dbEnvironment, j);
         if (type.isEmpty()) {
             continue;
         }
-        
-        for (int i = 0; i < maxConnections; ++i) {
-            QSqlDatabase db = QSqlDatabase::addDatabase(type, QString().sprintf("%02d_%d", j, i));
-            if (!db.isValid()) {
-                tWarn("Parameter 'DriverType' is invalid");
-                break;
-            }
-            tSystemDebug("Add Database successfully. name:%s", qPrintable(db.connectionName())); 
+
+        primaries.append(addGroup(type, dbEnvironment, j, -1, j));
+
+        // Adds the replicas, [env.replica1], [env.replica2], ..
+        QSettings &settings = Tf::app()->databaseSettings(j);
+        QStringList groups = settings.childGroups();
+        QVector<ConnectionGroup *> reps;
+        for (int r = 0; groups.contains(dbEnvironment + REPLICA_GROUP_SUFFIX + QString::number(r + 1)); ++r) {
+            QString env = dbEnvironment + REPLICA_GROUP_SUFFIX + QString::number(r + 1);
+            settings.beginGroup(env);
+            QString repType = settings.value("DriverType", type).toString().trimmed();
+            settings.endGroup();
+
+            reps << addGroup(repType, env, j, r, j);
+            tSystemDebug("Add replica database: %s", qPrintable(env));
+        }
+        replicas.append(reps);
+
+        settings.beginGroup(dbEnvironment);
+        QString balancing = settings.value(REPLICA_BALANCING_KEY).toString().trimmed();
+        settings.endGroup();
+        leastConnections.append(balancing.compare(QLatin1String("LeastConnections"), Qt::CaseInsensitive) == 0);
+    }
+
+    // Adds the shards, [env.shard1], [env.shard2], .. as virtual databases
+    int count = primaries.count();
+    shardIds.resize(count);
+    for (int j = 0; j < count; ++j) {
+        int settingsId = primaries[j]->settingsId;
+        QString type = driverType(dbEnvironment, settingsId);
+        QSettings &settings = Tf::app()->databaseSettings(settingsId);
+        QStringList groups = settings.childGroups();
+
+        shardIds[j] << j;
+        for (int s = 1; groups.contains(dbEnvironment + SHARD_GROUP_SUFFIX + QString::number(s)); ++s) {
+            QString env = dbEnvironment + SHARD_GROUP_SUFFIX + QString::number(s);
+            settings.beginGroup(env);
+            QString shardType = settings.value("DriverType", type).toString().trimmed();
+            settings.endGroup();
+
+            int id = primaries.count();
+            primaries.append(addGroup(shardType, env, id, -1, settingsId));
+            replicas.append(QVector<ConnectionGroup *>());
+            leastConnections.append(false);
+            shardIds[j] << id;
+            tSystemDebug("Add shard database: %s  id:%d", qPrintable(env), id);
         }
+    }
 
-        pooledConnections.append(QMap<QString, QDateTime>());
+    // Warms up the pool
+    for (int j = 0; j < primaries.count(); ++j) {
+        maintain(primaries[j]);
     }
 }
 
 
+TSqlDatabasePool::ConnectionGroup *TSqlDatabasePool::addGroup(const QString &type, const QString &env, int databaseId, int replica, int settingsId)
+{
+    ConnectionGroup *grp = new ConnectionGroup(env, databaseId, replica, settingsId);
+    for (int i = 0; i < maxConnections; ++i) {
+        QSqlDatabase db = QSqlDatabase::addDatabase(type, connectionName(databaseId, replica, i));
+        if (!db.isValid()) {
+            tWarn("Parameter 'DriverType' is invalid, %s", qPrintable(env));
+            break;
+        }
+        tSystemDebug("Add Database successfully. name:%s", qPrintable(db.connectionName()));
+        grp->connections << db;
+        grp->lastUsed << 0;
+        grp->nextFree << -1;
+    }
+
+    // The first connection on the top
+    for (int i = grp->connections.count() - 1; i >= 0; --i) {
+        grp->pushFree(i);
+    }
+    return grp;
+}
+
+/*
+  Returns the group of the connection named \a connectionName, in the
+  form of 'NN_I' for the primary database or 'NN_rR_I' for a replica.
+*/
+TSqlDatabasePool::ConnectionGroup *TSqlDatabasePool::group(const QString &connectionName) const
+{
+    bool ok;
+    int databaseId = connectionName.left(2).toInt(&ok);
+    if (!ok || databaseId < 0 || databaseId >= primaries.count()) {
+        return 0;
+    }
+
+    if (connectionName.length() > 3 && connectionName[3] == QLatin1Char('r')) {
+        int r = connectionName.mid(4).section(QLatin1Char('_'), 0, 0).toInt() - 1;
+        return replicas[databaseId].value(r);
+    }
+    return primaries[databaseId];
+}
+
+
 QSqlDatabase TSqlDatabasePool::pop(int databaseId)
 {
     T_TRACEFUNC("");
-    QMutexLocker locker(&mutex);
+
+    if (databaseId < 0 || databaseId >= primaries.count())
+        return QSqlDatabase();
+
+    return take(primaries[databaseId], true);
+}
+
+/*!
+  Returns a connection to a replica of the database \a databaseId, or
+  an invalid connection if no replica is configured or available. The
+  replica is selected in round-robin, or by the least number of the
+  connections in use if the parameter 'ReplicaBalancing' of the
+  database settings is 'LeastConnections'. A replica which failed to
+  connect is skipped for a while.
+*/
+QSqlDatabase TSqlDatabasePool::popReplica(int databaseId)
+{
+    T_TRACEFUNC("");
 
     QSqlDatabase db;
-    if (databaseId < 0 || databaseId >= pooledConnections.count())
+    if (databaseId < 0 || databaseId >= replicas.count())
         return db;
 
-    if (maxConnections > 0) {
-        QMap<QString, QDateTime> &map = pooledConnections[databaseId];
-        QMap<QString, QDateTime>::iterator it = map.begin();
-        while (it != map.end()) {
-            db = QSqlDatabase::database(it.key(), false);
-            it = map.erase(it);
-            if (db.isOpen()) {
-                tSystemDebug("pop database: %s", qPrintable(db.connectionName()));
-                return db;
-            } else {
-                tSystemError("Pooled database is not open: %s  [%s:%d]", qPrintable(db.connectionName()), __FILE__, __LINE__);
-            }
+    for (int n = 0; n < replicas[databaseId].count(); ++n) {
+        int r = selectReplica(databaseId);
+        if (r < 0) {
+            break;  // no available replica
         }
-        
-        for (int i = 0; i < maxConnections; ++i) {
-            db = QSqlDatabase::database(QString().sprintf("%02d_%d", databaseId, i), false);
-            if (!db.isOpen()) {
-                break;
+
+        db = take(replicas[databaseId][r], false);
+        if (db.isValid()) {
+            break;
+        }
+    }
+    return db;
+}
+
+/*
+  Takes a free connection of the group \a group, opening it if needed.
+  If no connection is free, waits for one if \a wait is true.
+*/
+QSqlDatabase TSqlDatabasePool::take(ConnectionGroup *group, bool wait)
+{
+    int idx;
+    if (!group->popFree(idx)) {
+        if (!wait) {
+            return QSqlDatabase();
+        }
+
+        QElapsedTimer waitTimer;
+        waitTimer.start();
+        while (!group->popFree(idx)) {
+            // Waits for the connections held by maintain() anyway
+            if (waitTimer.elapsed() >= waitTimeout && group->maintaining.fetchAndAddRelaxed(0) == 0) {
+                recordWait(waitTimer.elapsed());
+                throw RuntimeException("No pooled connection", __FILE__, __LINE__);
             }
+            Tf::msleep(1);
         }
-        
-        if (db.isOpen()) {
-            throw RuntimeException("No pooled connection", __FILE__, __LINE__);
+        recordWait(waitTimer.elapsed());
+    }
+
+    QSqlDatabase db = group->connections[idx];
+    if (db.isOpen() && validationInterval >= 0 && uptime() - group->lastUsed[idx] >= validationInterval && !validate(db)) {
+        tSystemWarn("Pooled database connection is broken: %s", qPrintable(db.connectionName()));
+        TSqlStatementCache::clear(db.connectionName());
+        db.close();
+    }
+
+    if (!db.isOpen()) {
+        TSqlStatementCache::clear(db.connectionName());
+        if (!openDatabase(db, group->environment, group->settingsId)) {
+            if (group->replica >= 0) {
+                tSystemWarn("Replica unavailable: %s", qPrintable(group->environment));
+                group->retryTime.fetchAndStoreOrdered(uptime() + REPLICA_RETRY_INTERVAL);
+            }
+            group->pushFree(idx);
+            return QSqlDatabase();
         }
-        
-        openDatabase(db, dbEnvironment, databaseId);
-        tSystemDebug("pop database: %s", qPrintable(db.connectionName()));
     }
+
+    group->activeCount.ref();
+    tSystemDebug("pop database: %s", qPrintable(db.connectionName()));
     return db;
 }
 
+/*
+  Returns the index of the replica to connect next, or -1 if none is
+  available.
+*/
+int TSqlDatabasePool::selectReplica(int databaseId)
+{
+    const QVector<ConnectionGroup *> &reps = replicas[databaseId];
+    int now = uptime();
+    int start = (int)((uint)primaries[databaseId]->counter.fetchAndAddRelaxed(1) % (uint)reps.count());
+
+    int sel = -1;
+    int selCount = 0;
+    for (int n = 0; n < reps.count(); ++n) {
+        int r = (start + n) % reps.count();
+        if (reps[r]->retryTime.fetchAndAddRelaxed(0) > now) {
+            continue;  // failed recently
+        }
+
+        if (!leastConnections[databaseId]) {
+            return r;
+        }
+
+        int cnt = reps[r]->activeCount.fetchAndAddRelaxed(0);
+        if (sel < 0 || cnt < selCount) {
+            sel = r;
+            selCount = cnt;
+        }
+    }
+    return sel;
+}
+
+/*!
+  Returns the number of the replicas of the database \a databaseId.
+*/
+int TSqlDatabasePool::replicaCount(int databaseId) const
+{
+    return (databaseId >= 0 && databaseId < replicas.count()) ? replicas[databaseId].count() : 0;
+}
+
+/*!
+  Returns the number of the shards of the database \a databaseId,
+  including the database itself, or 1 if it is not sharded.
+*/
+int TSqlDatabasePool::shardCount(int databaseId) const
+{
+    return (databaseId >= 0 && databaseId < shardIds.count()) ? shardIds[databaseId].count() : 1;
+}
+
+/*!
+  Returns the ID of the database holding the shard \a shard of the
+  database \a databaseId. The shard 0 is the database itself.
+*/
+int TSqlDatabasePool::shardDatabaseId(int databaseId, int shard) const
+{
+    return (databaseId >= 0 && databaseId < shardIds.count()) ? shardIds[databaseId].value(shard, databaseId) : databaseId;
+}
+
+/*!
+  Returns the shard of the database \a databaseId for the shard key
+  \a key. An integer key is mapped by its value modulo the number of
+  the shards, and any other key by the FNV-1a hash of its string.
+  If \a keyType is valid, the key is converted to the type before, so
+  that the values of a key given as different types, such as a string
+  "5" and an integer 5, are mapped to the same shard.
+*/
+int TSqlDatabasePool::shardOf(int databaseId, const QVariant &key, QVariant::Type keyType) const
+{
+    uint n = (uint)shardCount(databaseId);
+    if (n <= 1 || key.isNull()) {
+        return 0;
+    }
+
+    QVariant k = key;
+    if (keyType != QVariant::Invalid && k.type() != keyType && !k.convert(keyType)) {
+        k = key;
+    }
+
+    switch (k.type()) {
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+        return (int)(k.toULongLong() % n);
+
+    default: {
+        QByteArray str = k.toString().toUtf8();
+        uint hash = 2166136261u;
+        for (int i = 0; i < str.length(); ++i) {
+            hash ^= (uchar)str[i];
+            hash *= 16777619u;
+        }
+        return (int)(hash % n);
+    }
+    }
+}
+
+/*!
+  Returns the number of the database IDs, including the virtual
+  databases of the shards.
+*/
+int TSqlDatabasePool::databaseCount() const
+{
+    return qMax(primaries.count(), Tf::app()->databaseSettingsCount());
+}
+
+/*
+  Checks the connection \a database by a trivial query.
+*/
+bool TSqlDatabasePool::validate(QSqlDatabase &database) const
+{
+    QString driver = database.driverName().toUpper();
+    QString sql;
+    if (driver.startsWith(QLatin1String("QOCI"))) {
+        sql = QLatin1String("SELECT 1 FROM DUAL");
+    } else if (driver == QLatin1String("QDB2")) {
+        sql = QLatin1String("SELECT 1 FROM SYSIBM.SYSDUMMY1");
+    } else if (driver == QLatin1String("QIBASE")) {
+        sql = QLatin1String("SELECT 1 FROM RDB$DATABASE");
+    } else {
+        sql = QLatin1String("SELECT 1");
+    }
+
+    QSqlQuery query(database);
+    return query.exec(sql);
+}
+
+
+void TSqlDatabasePool::recordWait(qint64 msecs)
+{
+    QMutexLocker locker(&statsMutex);
+    ++waits;
+    totalWaitMsecs += msecs;
+    maxWaitMsecs = qMax(maxWaitMsecs, msecs);
+    tSystemDebug("Waited for a pooled connection: %lld msecs", msecs);
+}
+
+/*!
+  Returns the number of times pop() waited for a free connection.
+*/
+quint64 TSqlDatabasePool::waitCount() const
+{
+    QMutexLocker locker(&statsMutex);
+    return waits;
+}
+
+/*!
+  Returns the total time in milliseconds that pop() waited for free
+  connections.
+*/
+qint64 TSqlDatabasePool::totalWaitTime() const
+{
+    QMutexLocker locker(&statsMutex);
+    return totalWaitMsecs;
+}
+
+/*!
+  Returns the longest time in milliseconds that pop() waited for a free
+  connection.
+*/
+qint64 TSqlDatabasePool::maxWaitTime() const
+{
+    QMutexLocker locker(&statsMutex);
+    return maxWaitMsecs;
+}
+
 
 bool TSqlDatabasePool::openDatabase(QSqlDatabase &database, const QString &env, int databaseId)
 {
@@ -140,7 +551,7 @@ bool TSqlDatabasePool::openDatabase(QSqlDatabase &database, const QString &env,
     
     if (database.driverName().toUpper().startsWith("QSQLITE")) {
         QFileInfo fi(databaseName);
-        if (fi.isRelative()) {
+        if (fi.isRelative() && databaseName != QLatin1String(":memory:")) {
             // For SQLite
             databaseName = Tf::app()->webRootPath() + databaseName;
         }
@@ -188,14 +599,15 @@ bool TSqlDatabasePool::openDatabase(QSqlDatabase &database, const QString &env,
 void TSqlDatabasePool::push(QSqlDatabase &database)
 {
     T_TRACEFUNC("");
-    QMutexLocker locker(&mutex);
 
     if (database.isValid()) {
-        bool ok;
-        int databaseId = database.connectionName().left(2).toInt(&ok);
+        ConnectionGroup *grp = group(database.connectionName());
+        int idx = database.connectionName().section(QLatin1Char('_'), -1).toInt();
 
-        if (ok && databaseId >= 0 && databaseId < pooledConnections.count()) {
-            pooledConnections[databaseId].insert(database.connectionName(), QDateTime::currentDateTime());
+        if (grp && idx >= 0 && idx < grp->connections.count()) {
+            grp->lastUsed[idx] = uptime();
+            grp->activeCount.deref();
+            grp->pushFree(idx);
             tSystemDebug("push database: %s", qPrintable(database.connectionName()));
         } else {
             tSystemError("Invalid connection name: %s  [%s:%d]", qPrintable(database.connectionName()), __FILE__, __LINE__);
@@ -210,29 +622,118 @@ void TSqlDatabasePool::timerEvent(QTimerEvent *event)
     T_TRACEFUNC("");
 
     if (event->timerId() == timer.timerId()) {
-        // Closes extra-connection
-        if (mutex.tryLock()) {
-            for (int i = 0; i < pooledConnections.count(); ++i) {
-                QMap<QString, QDateTime> &map = pooledConnections[i];
-                QMap<QString, QDateTime>::iterator it = map.begin();
-                while (it != map.end()) {
-                    QDateTime dt = it.value();
-                    if (dt.addSecs(30) < QDateTime::currentDateTime()) {
-                        QSqlDatabase::database(it.key(), false).close();
-                        tSystemDebug("Closed database connection, name: %s", qPrintable(it.key()));
-                        it = map.erase(it);
-                    } else {
-                        ++it;
-                    }
-                }
+        for (int i = 0; i < primaries.count(); ++i) {
+            maintain(primaries[i]);
+        }
+        for (int i = 0; i < replicas.count(); ++i) {
+            for (int r = 0; r < replicas[i].count(); ++r) {
+                maintain(replicas[i][r]);
             }
-            mutex.unlock();
         }
     } else {
         QObject::timerEvent(event);
     }
 }
 
+/*
+  Closes the connections of the group \a group idle for the idle
+  timeout or beyond the maximum idle number, and opens connections up
+  to the minimum idle number. The free connections are taken out of the
+  free list only while the ones to close are selected and closed, and
+  the connections are opened one at a time with the others left in the
+  list. Meanwhile take() waits for them instead of failing.
+*/
+void TSqlDatabasePool::maintain(ConnectionGroup *group)
+{
+    QList<int> frees;
+    for (;;) {
+        int idx;
+        group->maintaining.ref();
+        if (!group->popFree(idx)) {
+            group->maintaining.deref();
+            break;
+        }
+
+        // Sorts by the last used time, most recent first
+        int pos = 0;
+        while (pos < frees.count() && group->lastUsed[frees[pos]] >= group->lastUsed[idx]) {
+            ++pos;
+        }
+        frees.insert(pos, idx);
+    }
+
+    int now = uptime();
+    int opened = 0;
+    for (int i = 0; i < frees.count(); ++i) {
+        QSqlDatabase &db = group->connections[frees[i]];
+        if (!db.isOpen()) {
+            continue;
+        }
+
+        if (opened >= maxIdle || (opened >= minIdle && now - group->lastUsed[frees[i]] >= idleTimeout)) {
+            TSqlStatementCache::clear(db.connectionName());
+            db.close();
+            tSystemDebug("Closed database connection, name: %s", qPrintable(db.connectionName()));
+        } else {
+            ++opened;
+        }
+    }
+
+    // Pushes back the closed ones first, so that open ones are taken first
+    for (int i = frees.count() - 1; i >= 0; --i) {
+        if (!group->connections[frees[i]].isOpen()) {
+            group->pushFree(frees[i]);
+            group->maintaining.deref();
+        }
+    }
+    for (int i = frees.count() - 1; i >= 0; --i) {
+        if (group->connections[frees[i]].isOpen()) {
+            group->pushFree(frees[i]);
+            group->maintaining.deref();
+        }
+    }
+
+    // Warms up connections, taking one closed connection at a time
+    for (; opened < minIdle && group->retryTime.fetchAndAddRelaxed(0) <= now; ++opened) {
+        int idx = -1;
+        QList<int> others;
+        for (;;) {
+            int i;
+            group->maintaining.ref();
+            if (!group->popFree(i)) {
+                group->maintaining.deref();
+                break;
+            }
+            if (!group->connections[i].isOpen()) {
+                idx = i;
+                break;
+            }
+            others << i;
+        }
+        for (int i = others.count() - 1; i >= 0; --i) {
+            group->pushFree(others[i]);
+            group->maintaining.deref();
+        }
+        if (idx < 0) {
+            break;
+        }
+
+        QSqlDatabase db = group->connections[idx];
+        bool ok = openDatabase(db, group->environment, group->settingsId);
+        if (ok) {
+            group->lastUsed[idx] = now;
+            tSystemDebug("Opened idle database connection, name: %s", qPrintable(db.connectionName()));
+        } else if (group->replica >= 0) {
+            group->retryTime.fetchAndStoreOrdered(now + REPLICA_RETRY_INTERVAL);
+        }
+        group->pushFree(idx);
+        group->maintaining.deref();
+        if (!ok) {
+            break;
+        }
+    }
+}
+
 
 /*!
  * Initializes.
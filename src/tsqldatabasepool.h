@@ -4,10 +4,10 @@
 #include <QObject>
 #include <QSqlDatabase>
 #include <QVector>
-#include <QMap>
 #include <QString>
+#include <QVariant>
 #include <QMutex>
-#include <QDateTime>
+#include <QElapsedTimer>
 #include <QBasicTimer>
 #include <TGlobal>
 
@@ -18,9 +18,19 @@ class T_CORE_EXPORT TSqlDatabasePool : QObject
 public:
     ~TSqlDatabasePool();
     QSqlDatabase pop(int databaseId = 0);
+    QSqlDatabase popReplica(int databaseId = 0);
     void push(QSqlDatabase &database);
+    int replicaCount(int databaseId = 0) const;
+    int shardCount(int databaseId = 0) const;
+    int shardDatabaseId(int databaseId, int shard) const;
+    int shardOf(int databaseId, const QVariant &key, QVariant::Type keyType = QVariant::Invalid) const;
+    int databaseCount() const;
     const QString &environment() const { return dbEnvironment; }
 
+    quint64 waitCount() const;
+    qint64 totalWaitTime() const;
+    qint64 maxWaitTime() const;
+
     static void instantiate();
     static TSqlDatabasePool *instance();
 
@@ -33,14 +43,37 @@ protected:
 
 private:
     Q_DISABLE_COPY(TSqlDatabasePool)
-    
+
+    struct ConnectionGroup;
+
     TSqlDatabasePool(const QString &environment);
+    ConnectionGroup *addGroup(const QString &type, const QString &env, int databaseId, int replica, int settingsId);
+    ConnectionGroup *group(const QString &connectionName) const;
+    QSqlDatabase take(ConnectionGroup *group, bool wait);
+    int selectReplica(int databaseId);
+    bool validate(QSqlDatabase &database) const;
+    void maintain(ConnectionGroup *group);
+    void recordWait(qint64 msecs);
+    int uptime() const { return (int)(clock.elapsed() / 1000); }
 
     int maxConnections;
-    QVector<QMap<QString, QDateTime> > pooledConnections;
-    QMutex mutex;
+    int minIdle;
+    int maxIdle;
+    int idleTimeout;
+    int validationInterval;
+    int waitTimeout;
+    QVector<ConnectionGroup *> primaries;
+    QVector<QVector<ConnectionGroup *> > replicas;
+    QVector<bool> leastConnections;
+    QVector<QVector<int> > shardIds;
     QString dbEnvironment;
+    QElapsedTimer clock;
     QBasicTimer timer;
+
+    mutable QMutex statsMutex;
+    quint64 waits;
+    qint64 totalWaitMsecs;
+    qint64 maxWaitMsecs;
 };
 
 #endif // TSQLDATABASEPOOL_H
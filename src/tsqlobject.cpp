@@ -11,21 +11,60 @@
 #include <TSqlObject>
 #include <TActionContext>
 #include <TSqlQuery>
+#include <TSqlStatementCache>
+#include <TSqlObjectMetaData>
+#include <TSqlDatabasePool>
 #include <TSystemGlobal>
 
-#define REVISION_PROPERTY_NAME  "lock_revision"
+static QHash<QString, bool> sqliteUpsertSupported;  // key: connection name
+static QMutex sqliteUpsertMutex;
+
+/*
+  Returns true if the SQLite library of the connection \a database is
+  3.24 or later, which supports 'ON CONFLICT DO UPDATE'. The version is
+  queried once per connection.
+*/
+static bool isSqliteUpsertSupported(const QSqlDatabase &database)
+{
+    QString name = database.connectionName();
+    {
+        QMutexLocker locker(&sqliteUpsertMutex);
+        QHash<QString, bool>::const_iterator it = sqliteUpsertSupported.constFind(name);
+        if (it != sqliteUpsertSupported.constEnd()) {
+            return it.value();
+        }
+    }
+
+    bool supported = false;
+    QSqlQuery query(database);
+    if (query.exec("SELECT sqlite_version()") && query.next()) {
+        QStringList ver = query.value(0).toString().split(QLatin1Char('.'));
+        int major = ver.value(0).toInt();
+        int minor = ver.value(1).toInt();
+        supported = (major > 3 || (major == 3 && minor >= 24));
+        tSystemDebug("SQLite version: %s", qPrintable(query.value(0).toString()));
+    }
+
+    QMutexLocker locker(&sqliteUpsertMutex);
+    sqliteUpsertSupported.insert(name, supported);
+    return supported;
+}
 
 /*!
   \class TSqlObject
   \brief The TSqlObject class is the base class of ORM objects.
-  \sa TSqlORMapper
+
+  The INSERT, UPDATE and DELETE statements are executed as prepared
+  statements with placeholders, and are kept in the statement cache of
+  the connection.
+  \sa TSqlORMapper, TSqlStatementCache
 */
 
 /*!
   Constructor.
  */
 TSqlObject::TSqlObject()
-    : QObject(), QSqlRecord(), tblName(), sqlError()
+    : QObject(), QSqlRecord(), tblName(), sqlError(), meta(0)
 { }
 
 /*!
@@ -33,7 +72,7 @@ TSqlObject::TSqlObject()
  */
 TSqlObject::TSqlObject(const TSqlObject &other)
     : QObject(), QSqlRecord(*static_cast<const QSqlRecord *>(&other)),
-      tblName(other.tblName), sqlError(other.sqlError)
+      tblName(other.tblName), sqlError(other.sqlError), meta(other.meta)
 { }
 
 /*!
@@ -44,6 +83,7 @@ TSqlObject &TSqlObject::operator=(const TSqlObject &other)
     QSqlRecord::operator=(*static_cast<const QSqlRecord *>(&other));
     tblName = other.tblName;
     sqlError = other.sqlError;
+    meta = other.meta;
     return *this;
 }
 
@@ -60,7 +100,9 @@ QString TSqlObject::tableName() const
             }
             tblName += clsname[i].toLower();
         }
-        tblName.remove(QRegExp("_object$"));
+        if (tblName.endsWith(QLatin1String("_object"))) {
+            tblName.chop(7);
+        }
     }
     return tblName;
 }
@@ -82,6 +124,15 @@ QString TSqlObject::tableName() const
   Returns the database ID.
 */
 
+/*!
+  \fn virtual int TSqlObject::shardKeyIndex() const
+  Returns the position of the shard key field, or -1 if the rows are
+  not sharded. The rows of a sharded class are distributed over the
+  shards of the database by the value of the shard key, which must not
+  be modified after the row is created.
+  \sa TSqlDatabasePool::shardOf()
+*/
+
 /*!
   \fn bool TSqlObject::isNull() const
   Returns true if there is no database record associated with the
@@ -110,38 +161,31 @@ void TSqlObject::setRecord(const QSqlRecord &record, const QSqlError &error)
     sqlError = error;
 }
 
+/*!
+  Returns the metadata of the class of the object.
+  This function is for internal use only.
+*/
+const TSqlObjectMetaData *TSqlObject::metaData() const
+{
+    if (!meta) {
+        meta = TSqlObjectMetaData::get(*this, TActionContext::current()->getReadDatabase(databaseId()));
+    }
+    return meta;
+}
+
 /*!
   Inserts new record into the database, based on the current properties
   of the object.
 */
 bool TSqlObject::create()
 {
-    // Sets the default value of 'revision' property
-    int index = metaObject()->indexOfProperty(REVISION_PROPERTY_NAME);
-    if (index >= 0) {
-        setProperty(REVISION_PROPERTY_NAME, 1);  // 1 : default value
-    }
-
-    // Sets the values of 'created_at', 'updated_at' or 'modified_at' properties
-    for (int i = metaObject()->propertyOffset(); i < metaObject()->propertyCount(); ++i) {
-        const char *propName = metaObject()->property(i).name();
-        if (QLatin1String("created_at") == propName || QLatin1String("updated_at") == propName
-            || QLatin1String("modified_at") == propName) {
-            setProperty(propName, QDateTime::currentDateTime());
-        }
-    }
-
-    syncToSqlRecord();
-    
-    QString autoValName;
-    QSqlRecord record = *this;
-    if (autoValueIndex() >= 0) {
-        autoValName = field(autoValueIndex()).name();
-        record.remove(autoValueIndex()); // not insert the value of auto-value field
-    }
+    QSqlRecord record = recordToCreate();
+    const TSqlObjectMetaData *md = metaData();
 
-    QSqlDatabase &database = TActionContext::current()->getDatabase(databaseId());
-    QString ins = database.driver()->sqlStatement(QSqlDriver::InsertStatement, tableName(), record, false);
+    QSqlDatabase &database = TActionContext::current()->getDatabase(shardDatabaseId());
+    TActionContext::current()->beginTransaction(database);
+    TActionContext::current()->invalidateResultCache(md->tableName());
+    QString ins = database.driver()->sqlStatement(QSqlDriver::InsertStatement, md->escapedTableName(), record, true);
     if (ins.isEmpty()) {
         sqlError = QSqlError(QLatin1String("No fields to insert"),
                              QString(), QSqlError::StatementError);
@@ -149,24 +193,87 @@ bool TSqlObject::create()
         return false;
     }
 
-    QSqlQuery query(database);
-    bool ret = query.exec(ins);
-    tQueryLog("%s", qPrintable(ins));
+    QVariantList values;
+    for (int i = 0; i < record.count(); ++i) {
+        if (record.isGenerated(i)) {
+            values << record.value(i);
+        }
+    }
+
+    bool ret;
+    QSqlQuery query = TSqlStatementCache::prepare(database, ins, &ret);
+    if (ret) {
+        ret = TSqlStatementCache::exec(query, values);
+    }
     sqlError = query.lastError();
     if (!ret) {
         tSystemError("SQL insert error: %s", qPrintable(sqlError.text()));
     } else {
         // Gets the last inserted value of auto-value field
-        if (autoValueIndex() >= 0) {
+        if (md->autoValueIndex() >= 0) {
             QVariant lastid = query.lastInsertId();
             if (lastid.isValid()) {
-                QObject::setProperty(autoValName.toLower().toLatin1().constData(), lastid);
+                writeProperty(md->autoValueIndex(), lastid);
             }
         }
     }
+    query.finish();
     return ret;
 }
 
+/*!
+  Returns the ID of the database holding the row, which is the shard
+  for the value of the shard key if the class is sharded.
+  This function is for internal use only.
+*/
+int TSqlObject::shardDatabaseId() const
+{
+    int id = databaseId();
+    int key = shardKeyIndex();
+    if (key >= 0) {
+        TSqlDatabasePool *pool = TSqlDatabasePool::instance();
+        id = pool->shardDatabaseId(id, pool->shardOf(id, readProperty(key)));
+    }
+    return id;
+}
+
+/*!
+  Sets the default values of the 'lock_revision', 'created_at',
+  'updated_at' and 'modified_at' properties, synchronizes the properties
+  to the internal record and returns the record to insert, without the
+  auto-value field. This function is for internal use only.
+*/
+QSqlRecord TSqlObject::recordToCreate()
+{
+    const TSqlObjectMetaData *md = metaData();
+
+    // Sets the default value of 'revision' property
+    if (md->revisionIndex() >= 0) {
+        writeProperty(md->revisionIndex(), 1);  // 1 : default value
+    }
+
+    // Sets the values of 'created_at', 'updated_at' or 'modified_at' properties
+    QDateTime now = QDateTime::currentDateTime();
+    if (md->createdAtIndex() >= 0) {
+        writeProperty(md->createdAtIndex(), now);
+    }
+    if (md->updatedAtIndex() >= 0) {
+        writeProperty(md->updatedAtIndex(), now);
+    }
+    if (md->modifiedAtIndex() >= 0) {
+        writeProperty(md->modifiedAtIndex(), now);
+    }
+
+    syncToSqlRecord();
+
+    QSqlRecord record = *this;
+    int autoIndex = md->recordIndex(md->autoValueIndex());
+    if (autoIndex >= 0) {
+        record.remove(autoIndex); // not insert the value of auto-value field
+    }
+    return record;
+}
+
 /*!
   Updates the corresponding record with the properties of the object.
 */
@@ -179,12 +286,23 @@ bool TSqlObject::update()
         return false;
     }
 
-    QSqlDatabase &database = TActionContext::current()->getDatabase(databaseId());
+    const TSqlObjectMetaData *md = metaData();
+    if (md->primaryKeyIndex() < 0) {
+        QString msg = QString("Not found the primary key for table ") + md->tableName();
+        sqlError = QSqlError(msg, QString(), QSqlError::StatementError);
+        tError("%s", qPrintable(msg));
+        return false;
+    }
+
+    QSqlDatabase &database = TActionContext::current()->getDatabase(shardDatabaseId());
+    TActionContext::current()->beginTransaction(database);
+    TActionContext::current()->invalidateResultCache(md->tableName());
     QString where(" WHERE ");
-    int revIndex = metaObject()->indexOfProperty(REVISION_PROPERTY_NAME);
+    QVariantList whereValues;
+    int revIndex = md->revisionIndex();
     if (revIndex >= 0) {
         bool ok;
-        int oldRevision = property(REVISION_PROPERTY_NAME).toInt(&ok);
+        int oldRevision = readProperty(revIndex).toInt(&ok);
         if (!ok || oldRevision <= 0) {
             sqlError = QSqlError(QLatin1String("Unable to convert the 'revision' property to an int"),
                                  QString(), QSqlError::UnknownError);
@@ -192,35 +310,39 @@ bool TSqlObject::update()
             return false;
         }
 
-        setProperty(REVISION_PROPERTY_NAME, oldRevision + 1);
+        writeProperty(revIndex, oldRevision + 1);
         
-        where.append(TSqlQuery::escapeIdentifier(REVISION_PROPERTY_NAME, QSqlDriver::FieldName, database));
-        where.append("=").append(TSqlQuery::formatValue(oldRevision, database));
-        where.append(" AND ");
+        where.append(md->escapedPropertyName(revIndex));
+        where.append("=? AND ");
+        whereValues << oldRevision;
     }
 
     // Updates the value of 'updated_at' or 'modified_at'property
-    for (int i = metaObject()->propertyOffset(); i < metaObject()->propertyCount(); ++i) {
-        const char *propName = metaObject()->property(i).name();
-        if (QLatin1String("updated_at") == propName || QLatin1String("modified_at") == propName) {
-            setProperty(propName, QDateTime::currentDateTime());
-            break;
-        }
+    QDateTime now = QDateTime::currentDateTime();
+    if (md->updatedAtIndex() >= 0) {
+        writeProperty(md->updatedAtIndex(), now);
+    }
+    if (md->modifiedAtIndex() >= 0) {
+        writeProperty(md->modifiedAtIndex(), now);
     }
 
     QString upd;   // UPDATE Statement
+    QVariantList values;
     upd.reserve(256);
-    upd.append(QLatin1String("UPDATE ")).append(tableName()).append(QLatin1String(" SET "));
+    upd.append(QLatin1String("UPDATE ")).append(md->escapedTableName()).append(QLatin1String(" SET "));
 
-    for (int i = metaObject()->propertyOffset(); i < metaObject()->propertyCount(); ++i) {
-        const char *propName = metaObject()->property(i).name();
-        QVariant newval = QObject::property(propName);
-        QVariant recval = QSqlRecord::value(QLatin1String(propName));
+    for (int i = 0; i < md->propertyCount(); ++i) {
+        int idx = md->recordIndex(i);
+        if (idx < 0 || idx >= QSqlRecord::count()) {
+            continue;
+        }
+
+        QVariant newval = readProperty(i);
+        QVariant recval = QSqlRecord::value(idx);
         if (recval.isValid() && recval != newval) {
-            upd.append(TSqlQuery::escapeIdentifier(QLatin1String(propName), QSqlDriver::FieldName, database));
-            upd.append(QLatin1Char('='));
-            upd.append(TSqlQuery::formatValue(newval, database));
-            upd.append(QLatin1String(", "));
+            upd.append(md->escapedPropertyName(i));
+            upd.append(QLatin1String("=?, "));
+            values << newval;
         }
     }
 
@@ -232,29 +354,28 @@ bool TSqlObject::update()
     upd.chop(2);
     syncToSqlRecord();
     
-    const char *pkName = metaObject()->property(metaObject()->propertyOffset() + primaryKeyIndex()).name();
-    if (primaryKeyIndex() < 0 || !pkName) {
-        QString msg = QString("Not found the primary key for table ") + tableName();
-        sqlError = QSqlError(msg, QString(), QSqlError::StatementError);
-        tError("%s", qPrintable(msg));
-        return false;
-    }
-    where.append(TSqlQuery::escapeIdentifier(pkName, QSqlDriver::FieldName, database));
-    where.append("=").append(TSqlQuery::formatValue(property(pkName), database));
+    where.append(md->escapedPropertyName(md->primaryKeyIndex()));
+    where.append("=?");
+    whereValues << readProperty(md->primaryKeyIndex());
     upd.append(where);
+    values << whereValues;
 
-    QSqlQuery query(database);
-    bool res = query.exec(upd);
-    tQueryLog("%s", qPrintable(upd));    
+    bool res;
+    QSqlQuery query = TSqlStatementCache::prepare(database, upd, &res);
+    if (res) {
+        res = TSqlStatementCache::exec(query, values);
+    }
     sqlError = query.lastError();
+    int numRows = query.numRowsAffected();
+    query.finish();
     if (!res) {
         tSystemError("SQL update error: %s", qPrintable(sqlError.text()));
         return false;
     }
     
     // Optimistic lock check
-    if (revIndex >= 0 && query.numRowsAffected() != 1) {
-        QString msg = QString("Row was updated or deleted from table ") + tableName() + QLatin1String(" by another transaction");
+    if (revIndex >= 0 && numRows != 1) {
+        QString msg = QString("Row was updated or deleted from table ") + md->tableName() + QLatin1String(" by another transaction");
         sqlError = QSqlError(msg, QString(), QSqlError::UnknownError);
         throw SqlException(msg, __FILE__, __LINE__);
     }
@@ -262,25 +383,171 @@ bool TSqlObject::update()
 }
 
 /*!
-  Deletes the record with this primary key from the database.
+  Inserts the record of the object into the database, or updates the
+  record with the same primary key if it exists, by one statement:
+  'INSERT ... ON CONFLICT DO UPDATE' for PostgreSQL and SQLite 3.24 or
+  later, and 'INSERT ... ON DUPLICATE KEY UPDATE' for MySQL. For the
+  other drivers and older SQLite, e.g. bundled with Qt 4, the record is
+  updated and inserted if no row is updated. The existing row is updated in place, not deleted.
+
+  The 'created_at' property is set only if it is null, and is not
+  updated. The 'lock_revision' property is incremented without the
+  optimistic lock check.
+  \sa create(), update()
 */
-bool TSqlObject::remove()
+bool TSqlObject::upsert()
 {
+    const TSqlObjectMetaData *md = metaData();
+    if (md->primaryKeyIndex() < 0) {
+        QString msg = QString("Not found the primary key for table ") + md->tableName();
+        sqlError = QSqlError(msg, QString(), QSqlError::StatementError);
+        tError("%s", qPrintable(msg));
+        return false;
+    }
+
+    QDateTime now = QDateTime::currentDateTime();
+    int revIndex = md->revisionIndex();
+    if (revIndex >= 0 && readProperty(revIndex).toInt() <= 0) {
+        writeProperty(revIndex, 1);  // 1 : default value
+    }
+    if (md->createdAtIndex() >= 0 && readProperty(md->createdAtIndex()).toDateTime().isNull()) {
+        writeProperty(md->createdAtIndex(), now);
+    }
+    if (md->updatedAtIndex() >= 0) {
+        writeProperty(md->updatedAtIndex(), now);
+    }
+    if (md->modifiedAtIndex() >= 0) {
+        writeProperty(md->modifiedAtIndex(), now);
+    }
     syncToSqlRecord();
 
-    QSqlDatabase &database = TActionContext::current()->getDatabase(databaseId());
-    QString del = database.driver()->sqlStatement(QSqlDriver::DeleteStatement, tableName(), *static_cast<QSqlRecord *>(this), false);
-    if (del.isEmpty()) {
-        sqlError = QSqlError(QLatin1String("Unable to delete row"),
+    QSqlDatabase &database = TActionContext::current()->getDatabase(shardDatabaseId());
+    TActionContext::current()->beginTransaction(database);
+    TActionContext::current()->invalidateResultCache(md->tableName());
+
+    QSqlRecord record = *this;
+    QString ins = database.driver()->sqlStatement(QSqlDriver::InsertStatement, md->escapedTableName(), record, true);
+    if (ins.isEmpty()) {
+        sqlError = QSqlError(QLatin1String("No fields to insert"),
                              QString(), QSqlError::StatementError);
+        tWarn("SQL statement error, no fields to insert");
+        return false;
+    }
+
+    QVariantList values;
+    for (int i = 0; i < record.count(); ++i) {
+        if (record.isGenerated(i)) {
+            values << record.value(i);
+        }
+    }
+
+    QString driverName = database.driverName().toUpper();
+    bool onConflict = driverName.startsWith(QLatin1String("QPSQL"))
+        || (driverName.startsWith(QLatin1String("QSQLITE")) && isSqliteUpsertSupported(database));
+    bool mysql = driverName.startsWith(QLatin1String("QMYSQL"));
+
+    if (onConflict || mysql) {
+        QString set;
+        for (int i = 0; i < md->propertyCount(); ++i) {
+            if (md->recordIndex(i) < 0 || i == md->primaryKeyIndex() || i == md->createdAtIndex()) {
+                continue;
+            }
+
+            QString name = md->escapedPropertyName(i);
+            set.append(name).append(QLatin1Char('='));
+            if (i == revIndex) {
+                if (onConflict) {
+                    set.append(md->escapedTableName()).append(QLatin1Char('.'));
+                }
+                set.append(name).append(QLatin1String("+1"));
+            } else if (onConflict) {
+                set.append(QLatin1String("EXCLUDED.")).append(name);
+            } else {
+                set.append(QLatin1String("VALUES(")).append(name).append(QLatin1Char(')'));
+            }
+            set.append(QLatin1String(", "));
+        }
+        set.chop(2);
+
+        if (onConflict) {
+            ins.append(QLatin1String(" ON CONFLICT (")).append(md->escapedPropertyName(md->primaryKeyIndex()));
+            ins.append((set.isEmpty()) ? QLatin1String(") DO NOTHING") : QLatin1String(") DO UPDATE SET "));
+        } else {
+            ins.append(QLatin1String(" ON DUPLICATE KEY UPDATE "));
+            if (set.isEmpty()) {
+                QString pk = md->escapedPropertyName(md->primaryKeyIndex());
+                set = pk + QLatin1Char('=') + pk;
+            }
+        }
+        ins.append(set);
+
+    } else {
+        // Updates the row, and inserts it if not found
+        QString upd = QLatin1String("UPDATE ") + md->escapedTableName() + QLatin1String(" SET ");
+        QVariantList updValues;
+        for (int i = 0; i < md->propertyCount(); ++i) {
+            if (md->recordIndex(i) < 0 || i == md->primaryKeyIndex() || i == md->createdAtIndex()) {
+                continue;
+            }
+            upd.append(md->escapedPropertyName(i)).append(QLatin1String("=?, "));
+            updValues << readProperty(i);
+        }
+
+        if (!updValues.isEmpty()) {
+            upd.chop(2);
+            upd.append(QLatin1String(" WHERE ")).append(md->escapedPropertyName(md->primaryKeyIndex())).append(QLatin1String("=?"));
+            updValues << readProperty(md->primaryKeyIndex());
+
+            bool res;
+            QSqlQuery query = TSqlStatementCache::prepare(database, upd, &res);
+            if (res) {
+                res = TSqlStatementCache::exec(query, updValues);
+            }
+            sqlError = query.lastError();
+            int numRows = query.numRowsAffected();
+            query.finish();
+            if (!res) {
+                tSystemError("SQL update error: %s", qPrintable(sqlError.text()));
+                return false;
+            }
+            if (numRows > 0) {
+                return true;
+            }
+        }
+    }
+
+    bool ret;
+    QSqlQuery query = TSqlStatementCache::prepare(database, ins, &ret);
+    if (ret) {
+        ret = TSqlStatementCache::exec(query, values);
+    }
+    sqlError = query.lastError();
+    query.finish();
+    if (!ret) {
+        tSystemError("SQL upsert error: %s", qPrintable(sqlError.text()));
+    }
+    return ret;
+}
+
+/*!
+  Deletes the record with this primary key from the database.
+*/
+bool TSqlObject::remove()
+{
+    const TSqlObjectMetaData *md = metaData();
+    if (md->primaryKeyIndex() < 0) {
+        QString msg = QString("Not found the primary key for table ") + md->tableName();
+        sqlError = QSqlError(msg, QString(), QSqlError::StatementError);
+        tError("%s", qPrintable(msg));
         return false;
     }
 
-    del.append(" WHERE ");
-    int revIndex = metaObject()->indexOfProperty(REVISION_PROPERTY_NAME);
+    QString del = QLatin1String("DELETE FROM ") + md->escapedTableName() + QLatin1String(" WHERE ");
+    QVariantList values;
+    int revIndex = md->revisionIndex();
     if (revIndex >= 0) {
         bool ok;
-        int revsion = property(REVISION_PROPERTY_NAME).toInt(&ok);
+        int revsion = readProperty(revIndex).toInt(&ok);
         if (!ok || revsion <= 0) {
             sqlError = QSqlError(QLatin1String("Unable to convert the 'revision' property to an int"),
                                  QString(), QSqlError::UnknownError);
@@ -288,38 +555,39 @@ bool TSqlObject::remove()
             return false;
         }
 
-        del.append(TSqlQuery::escapeIdentifier(REVISION_PROPERTY_NAME, QSqlDriver::FieldName, database));
-        del.append("=").append(TSqlQuery::formatValue(revsion, database));
-        del.append(" AND ");
+        del.append(md->escapedPropertyName(revIndex));
+        del.append("=? AND ");
+        values << revsion;
     }
 
-    const char *pkName = metaObject()->property(metaObject()->propertyOffset() + primaryKeyIndex()).name();
-    if (primaryKeyIndex() < 0 || !pkName) {
-        QString msg = QString("Not found the primary key for table ") + tableName();
-        sqlError = QSqlError(msg, QString(), QSqlError::StatementError);
-        tError("%s", qPrintable(msg));
-        return false;
+    del.append(md->escapedPropertyName(md->primaryKeyIndex()));
+    del.append("=?");
+    values << readProperty(md->primaryKeyIndex());
+
+    QSqlDatabase &database = TActionContext::current()->getDatabase(shardDatabaseId());
+    TActionContext::current()->beginTransaction(database);
+    TActionContext::current()->invalidateResultCache(md->tableName());
+    bool res;
+    QSqlQuery query = TSqlStatementCache::prepare(database, del, &res);
+    if (res) {
+        res = TSqlStatementCache::exec(query, values);
     }
-    del.append(TSqlQuery::escapeIdentifier(pkName, QSqlDriver::FieldName, database));
-    del.append("=").append(TSqlQuery::formatValue(property(pkName), database));
-
-    QSqlQuery query(database);
-    bool res = query.exec(del);
-    tQueryLog("%s", qPrintable(del));
     sqlError = query.lastError();
+    int numRows = query.numRowsAffected();
+    query.finish();
     if (!res) {
         tSystemError("SQL delete error: %s", qPrintable(sqlError.text()));
         return false;
     }
     
     // Optimistic lock check
-    if (query.numRowsAffected() != 1) {
+    if (numRows != 1) {
         if (revIndex >= 0) {
-            QString msg = QString("Row was updated or deleted from table ") + tableName() + QLatin1String(" by another transaction");
+            QString msg = QString("Row was updated or deleted from table ") + md->tableName() + QLatin1String(" by another transaction");
             sqlError = QSqlError(msg, QString(), QSqlError::UnknownError);
             throw SqlException(msg, __FILE__, __LINE__);
         }
-        tWarn("Row was deleted by another transaction, %s", qPrintable(tableName()));
+        tWarn("Row was deleted by another transaction, %s", qPrintable(md->tableName()));
     }
 
     clear();
@@ -347,11 +615,11 @@ bool TSqlObject::isModified() const
     if (isNew())
         return false;
 
+    const TSqlObjectMetaData *md = metaData();
     for (int i = 0; i < QSqlRecord::count(); ++i) {
-        QString name = field(i).name().toLower();
-        int index = metaObject()->indexOfProperty(name.toLatin1().constData());
+        int index = md->indexOfProperty(field(i).name());
         if (index >= 0) {
-            if (value(name) != property(name.toLatin1().constData())) {
+            if (value(i) != readProperty(index)) {
                 return true;
             }
         }
@@ -365,12 +633,11 @@ bool TSqlObject::isModified() const
 */
 void TSqlObject::syncToObject()
 {
-    int offset = metaObject()->propertyOffset();
+    const TSqlObjectMetaData *md = metaData();
     for (int i = 0; i < QSqlRecord::count(); ++i) {
-        QString propertyName = field(i).name();
-        int index = metaObject()->indexOfProperty(propertyName.toLower().toLatin1().constData());
-        if (index >= offset) {
-            QObject::setProperty(propertyName.toLower().toLatin1().constData(), value(propertyName));
+        int index = md->indexOfProperty(field(i).name());
+        if (index >= 0) {
+            writeProperty(index, value(i));
         }
     }
 }
@@ -381,19 +648,38 @@ void TSqlObject::syncToObject()
 */
 void TSqlObject::syncToSqlRecord()
 {
-    QSqlRecord::operator=(TActionContext::current()->getDatabase(databaseId()).record(tableName()));
-    const QMetaObject *metaObj = metaObject();
-    for (int i = metaObj->propertyOffset(); i < metaObj->propertyCount(); ++i) {
-        const char *propName = metaObj->property(i).name();
-        int idx = indexOf(propName);
+    const TSqlObjectMetaData *md = metaData();
+    QSqlRecord::operator=(md->record());
+    for (int i = 0; i < md->propertyCount(); ++i) {
+        int idx = md->recordIndex(i);
         if (idx >= 0) {
-            QSqlRecord::setValue(idx, QObject::property(propName));
+            QSqlRecord::setValue(idx, readProperty(i));
         } else {
-            tWarn("invalid name: %s", propName);
+            tWarn("invalid name: %s", qPrintable(md->propertyName(i)));
         }
     }
 }
 
+/*!
+  Returns the value of the property \a index, which is relative to the
+  property offset.
+*/
+QVariant TSqlObject::readProperty(int index) const
+{
+    const QMetaObject *metaObj = metaObject();
+    return metaObj->property(metaObj->propertyOffset() + index).read(this);
+}
+
+/*!
+  Sets the value of the property \a index, which is relative to the
+  property offset, to \a value.
+*/
+void TSqlObject::writeProperty(int index, const QVariant &value)
+{
+    const QMetaObject *metaObj = metaObject();
+    metaObj->property(metaObj->propertyOffset() + index).write(this, value);
+}
+
 /*!
   Returns a Hash object of the properties.
 */
@@ -8,6 +8,8 @@
 #include <QVariantHash>
 #include <TGlobal>
 
+class TSqlObjectMetaData;
+
 
 class T_CORE_EXPORT TSqlObject : public QObject, public QSqlRecord
 {
@@ -22,9 +24,11 @@ public:
     virtual int primaryKeyIndex() const { return -1; }
     virtual int autoValueIndex() const { return -1; }
     virtual int databaseId() const { return 0; }
+    virtual int shardKeyIndex() const { return -1; }
     void setRecord(const QSqlRecord &record, const QSqlError &error);
     bool create();
     bool update();
+    bool upsert();
     bool remove();
     bool reload();
     bool isNull() const { return isEmpty(); }
@@ -38,10 +42,19 @@ public:
 protected:
     void syncToSqlRecord();
     void syncToObject();
+    const TSqlObjectMetaData *metaData() const;
+    QVariant readProperty(int index) const;
+    void writeProperty(int index, const QVariant &value);
 
 private:
+    QSqlRecord recordToCreate();
+    int shardDatabaseId() const;
+
     mutable QString tblName;
     QSqlError sqlError;
+    mutable const TSqlObjectMetaData *meta;
+
+    template <class T> friend class TSqlORMapper;
 };
 
 #endif // TSQLOBJECT_H
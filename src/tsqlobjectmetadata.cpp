@@ -0,0 +1,188 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QPair>
+#include <QMetaObject>
+#include <QMetaProperty>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <TSqlObjectMetaData>
+#include <TSqlObject>
+#include <TSqlQuery>
+
+#define REVISION_PROPERTY_NAME  "lock_revision"
+
+/*!
+  \class TSqlObjectMetaData
+  \brief The TSqlObjectMetaData class holds the immutable metadata of an
+  ORM object class, such as the table name, the column names and the
+  indexes of the special properties.
+
+  The metadata is computed once per class and database driver and shared
+  by all the objects of the class, so that the ORM does not introspect
+  the QMetaObject and query the database schema on every call. Property
+  indexes are relative to the property offset of the class, like the
+  PropertyIndex enum of generated models.
+  \sa TSqlObject
+*/
+
+typedef QPair<const QMetaObject *, QString> MetaDataKey;
+
+static QHash<MetaDataKey, TSqlObjectMetaData *> metaDataHash;
+static QReadWriteLock metaDataLock;
+
+
+TSqlObjectMetaData::TSqlObjectMetaData()
+    : dbId(0), pkIndex(-1), autoIndex(-1), shardIndex(-1), shardType(QVariant::Invalid), revIndex(-1), createdIndex(-1), updatedIndex(-1), modifiedIndex(-1)
+{ }
+
+
+const TSqlObjectMetaData *TSqlObjectMetaData::find(const QMetaObject *metaObject, const QString &driverName)
+{
+    QReadLocker locker(&metaDataLock);
+    return metaDataHash.value(MetaDataKey(metaObject, driverName));
+}
+
+/*!
+  Returns the metadata of the class of the \a object for the driver of
+  the database \a database. It is computed the first time. If the
+  fields of the table could not be read, for example because the table
+  did not exist or the connection failed, it is computed again the next
+  time until the fields are read.
+*/
+const TSqlObjectMetaData *TSqlObjectMetaData::get(const TSqlObject &object, const QSqlDatabase &database)
+{
+    const QMetaObject *metaObj = object.metaObject();
+    const TSqlObjectMetaData *meta = find(metaObj, database.driverName());
+    if (meta && !meta->emptyRecord.isEmpty()) {
+        return meta;
+    }
+
+    QSqlRecord record = database.record(object.tableName());
+    if (meta && record.isEmpty()) {
+        // Still not available
+        return meta;
+    }
+
+    TSqlObjectMetaData *data = new TSqlObjectMetaData;
+    data->tblName = object.tableName();
+    data->escapedTblName = TSqlQuery::escapeIdentifier(data->tblName, QSqlDriver::TableName, database);
+    data->dbId = object.databaseId();
+    data->pkIndex = object.primaryKeyIndex();
+    data->autoIndex = object.autoValueIndex();
+    data->shardIndex = object.shardKeyIndex();
+    if (data->shardIndex >= 0) {
+        data->shardType = metaObj->property(metaObj->propertyOffset() + data->shardIndex).type();
+    }
+    data->emptyRecord = record;
+
+    for (int i = metaObj->propertyOffset(); i < metaObj->propertyCount(); ++i) {
+        QString name = QLatin1String(metaObj->property(i).name());
+        int idx = data->propNames.count();
+        data->propNames << name;
+        data->escapedPropNames << TSqlQuery::escapeIdentifier(name, QSqlDriver::FieldName, database);
+        data->propIndexes.insert(name.toLower(), idx);
+        data->recordIndexes << data->emptyRecord.indexOf(name);
+
+        if (name == QLatin1String(REVISION_PROPERTY_NAME)) {
+            data->revIndex = idx;
+        } else if (name == QLatin1String("created_at")) {
+            data->createdIndex = idx;
+        } else if (name == QLatin1String("updated_at")) {
+            data->updatedIndex = idx;
+        } else if (name == QLatin1String("modified_at")) {
+            data->modifiedIndex = idx;
+        }
+    }
+
+    QWriteLocker locker(&metaDataLock);
+    MetaDataKey key(metaObj, database.driverName());
+    meta = metaDataHash.value(key);
+    if (meta && (!meta->emptyRecord.isEmpty() || data->emptyRecord.isEmpty())) {
+        // Computed by another thread
+        delete data;
+        return meta;
+    }
+    // Replaces the metadata without fields, which is not deleted since
+    // it may be in use; this happens once per class at most
+    metaDataHash.insert(key, data);
+    return data;
+}
+
+/*!
+  Returns the index of the property \a name, compared case-insensitively,
+  or -1 if not found.
+*/
+int TSqlObjectMetaData::indexOfProperty(const QString &name) const
+{
+    return propIndexes.value(name.toLower(), -1);
+}
+
+
+/*!
+  \fn const QString &TSqlObjectMetaData::tableName() const
+  Returns the table name.
+*/
+
+/*!
+  \fn const QString &TSqlObjectMetaData::escapedTableName() const
+  Returns the table name escaped for the driver.
+*/
+
+/*!
+  \fn int TSqlObjectMetaData::propertyCount() const
+  Returns the number of the properties declared by the class.
+*/
+
+/*!
+  \fn QString TSqlObjectMetaData::propertyName(int index) const
+  Returns the name of the property \a index.
+*/
+
+/*!
+  \fn QString TSqlObjectMetaData::escapedPropertyName(int index) const
+  Returns the name of the property \a index escaped for the driver as
+  a field name.
+*/
+
+/*!
+  \fn int TSqlObjectMetaData::shardKeyIndex() const
+  Returns the index of the shard key property, or -1 if the class is
+  not sharded.
+*/
+
+/*!
+  \fn int TSqlObjectMetaData::revisionIndex() const
+  Returns the index of the 'lock_revision' property, or -1.
+*/
+
+/*!
+  \fn int TSqlObjectMetaData::createdAtIndex() const
+  Returns the index of the 'created_at' property, or -1.
+*/
+
+/*!
+  \fn int TSqlObjectMetaData::updatedAtIndex() const
+  Returns the index of the 'updated_at' property, or -1.
+*/
+
+/*!
+  \fn int TSqlObjectMetaData::modifiedAtIndex() const
+  Returns the index of the 'modified_at' property, or -1.
+*/
+
+/*!
+  \fn const QSqlRecord &TSqlObjectMetaData::record() const
+  Returns an empty record of the table, populated with the fields.
+*/
+
+/*!
+  \fn int TSqlObjectMetaData::recordIndex(int propertyIndex) const
+  Returns the position in record() of the field of the property
+  \a propertyIndex, or -1 if the table has no such field.
+*/
@@ -0,0 +1,81 @@
+#ifndef TSQLOBJECTMETADATA_H
+#define TSQLOBJECTMETADATA_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QVariant>
+#include <QSqlRecord>
+#include <QSqlDatabase>
+#include <TGlobal>
+
+class TSqlObject;
+
+
+class T_CORE_EXPORT TSqlObjectMetaData
+{
+public:
+    const QString &tableName() const { return tblName; }
+    const QString &escapedTableName() const { return escapedTblName; }
+    int databaseId() const { return dbId; }
+    int propertyCount() const { return propNames.count(); }
+    QString propertyName(int index) const { return propNames.value(index); }
+    QString escapedPropertyName(int index) const { return escapedPropNames.value(index); }
+    int indexOfProperty(const QString &name) const;
+    int primaryKeyIndex() const { return pkIndex; }
+    int autoValueIndex() const { return autoIndex; }
+    int shardKeyIndex() const { return shardIndex; }
+    QVariant::Type shardKeyType() const { return shardType; }
+    int revisionIndex() const { return revIndex; }
+    int createdAtIndex() const { return createdIndex; }
+    int updatedAtIndex() const { return updatedIndex; }
+    int modifiedAtIndex() const { return modifiedIndex; }
+    const QSqlRecord &record() const { return emptyRecord; }
+    int recordIndex(int propertyIndex) const { return recordIndexes.value(propertyIndex, -1); }
+
+    static const TSqlObjectMetaData *get(const TSqlObject &object, const QSqlDatabase &database);
+    template <class T> static const TSqlObjectMetaData *get(const QSqlDatabase &database);
+
+private:
+    TSqlObjectMetaData();
+    static const TSqlObjectMetaData *find(const QMetaObject *metaObject, const QString &driverName);
+
+    QString tblName;
+    QString escapedTblName;
+    int dbId;
+    QStringList propNames;
+    QStringList escapedPropNames;
+    QHash<QString, int> propIndexes;
+    int pkIndex;
+    int autoIndex;
+    int shardIndex;
+    QVariant::Type shardType;
+    int revIndex;
+    int createdIndex;
+    int updatedIndex;
+    int modifiedIndex;
+    QSqlRecord emptyRecord;
+    QVector<int> recordIndexes;
+
+    Q_DISABLE_COPY(TSqlObjectMetaData)
+};
+
+
+/*!
+  Returns the metadata of the ORM object class \a T for the driver of
+  the database \a database. An object of \a T is constructed only until
+  the metadata is complete.
+*/
+template <class T>
+inline const TSqlObjectMetaData *TSqlObjectMetaData::get(const QSqlDatabase &database)
+{
+    const TSqlObjectMetaData *meta = find(&T::staticMetaObject, database.driverName());
+    if (!meta || meta->emptyRecord.isEmpty()) {
+        T obj;
+        meta = get(obj, database);
+    }
+    return meta;
+}
+
+#endif // TSQLOBJECTMETADATA_H
@@ -3,10 +3,20 @@
 
 #include <QtSql>
 #include <QList>
+#include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
 #include <TSqlObject>
 #include <TCriteria>
 #include <TCriteriaConverter>
+#include <TSqlStatementCache>
+#include <TSqlResultCache>
+#include <TSqlQueryStatistics>
+#include <TSqlORMapperFuture>
+#include <TSqlObjectMetaData>
 #include <TActionContext>
+#include <TSqlDatabasePool>
 #include "tsystemglobal.h"
 
 /*!
@@ -15,9 +25,37 @@
   concise functionality to object-relational mapping.
   It can be used to retrieve TSqlObject objects with a TCriteria
   from a table.
-  \sa TSqlObject, TCriteria
+
+  The related objects of the retrieved objects can be loaded by one
+  'IN (...)' query per association, instead of one query per object:
+  \code
+  TSqlORMapper<CommentObject> mapper;
+  mapper.includeBelongsTo<BlogObject>(CommentObject::BlogId);
+  mapper.find(cri);
+  TSqlORMapperIterator<CommentObject> it(mapper);
+  while (it.hasNext()) {
+      CommentObject comment = it.next();
+      BlogObject blog = mapper.belongsTo<BlogObject>(comment, CommentObject::BlogId);
+      ...
+  }
+  \endcode
+
+  The results of lookups which run frequently with the same criteria,
+  such as of a table of categories, can be kept in the result cache by
+  setResultCache(). The cached results are invalidated when a row of
+  the table is written by TSqlObject or TSqlORMapper.
+
+  If the class is sharded by TSqlObject::shardKeyIndex(), an operation
+  whose criteria has an 'Equal' condition of the shard key runs on the
+  shard of the key only. Otherwise it runs on all the shards, and the
+  rows retrieved are merged in the sort order and limited in memory.
+  A write to several shards runs one transaction per shard, so it is
+  not atomic.
+  \sa TSqlObject, TCriteria, TSqlResultCache
 */
 
+template <class T> class TSqlORMapperCursor;
+
 
 template <class T>
 class TSqlORMapper : public QSqlTableModel
@@ -29,15 +67,29 @@ public:
     void setLimit(int limit);
     void setOffset(int offset);
     void setSortOrder(int column, TSql::SortOrder order);
+    void setProjection(const QList<int> &properties);
+    void setResultCache(bool enable, int lifeTime = 0);
     void reset();
 
     T findFirst(const TCriteria &cri = TCriteria());
     T findByPrimaryKey(QVariant pk);
     int find(const TCriteria &cri = TCriteria());
+    int findAfter(int column, const QVariant &lastValue, int limit, const TCriteria &cri = TCriteria(), TSql::SortOrder order = TSql::AscendingOrder);
+    int findCount(const TCriteria &cri = TCriteria());
+    TSqlORMapperFuture<T> findAsync(const TCriteria &cri = TCriteria()) const;
+    bool exists(const TCriteria &cri = TCriteria());
     T first() const;
     T last() const;
     T value(int i) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
     int removeAll(const TCriteria &cri = TCriteria());
+    int insertAll(const QList<T> &objects, QVariantList *generatedIds = 0);
+    int updateAll(const TCriteria &cri, const QMap<int, QVariant> &values);
+
+    template <class R> void includeBelongsTo(int foreignKey);
+    template <class R> void includeHasMany(int relatedForeignKey);
+    template <class R> R belongsTo(const T &object, int foreignKey) const;
+    template <class R> QList<R> hasMany(const T &object, int relatedForeignKey) const;
 
 protected:
     void setFilter(const QString &filter);
@@ -46,13 +98,57 @@ protected:
     virtual QString selectStatement() const;
 
 private:
+    T selectFirst(const TCriteria &cri);
+    QSqlRecord row(int i) const;
+    QString selectStatement(const TCriteria &cri, QVariantList &values, int limit, int offset) const;
+    QString baseSelectStatement() const;
+    QList<QSqlRecord> gather(const TCriteria &cri, const QList<int> &databaseIds, int limit, bool *ok);
+    int insertRecords(int databaseId, const QList<QSqlRecord> &records, QVariantList *generatedIds);
+    QList<int> shardDatabaseIds(const TCriteria &cri) const;
+    QSqlDatabase readDatabase(int databaseId) const;
+    QSqlDatabase writeDatabase(int databaseId) const;
+
+    typedef QHash<QString, QList<QSqlRecord> > RecordHash;
+
+    struct Association
+    {
+        const QMetaObject *related;
+        int localColumn;    // property of T holding the key
+        int relatedColumn;  // property of the related class matched with the key
+        void (*load)(int column, const QVariantList &keys, RecordHash &records);
+        RecordHash records;
+    };
+
+    void loadAssociations();
+    const Association *association(const QMetaObject *related, int localColumn, int relatedColumn) const;
+    template <class R> static void loadRecords(int column, const QVariantList &keys, RecordHash &records);
+
+    struct RecordLessThan
+    {
+        RecordLessThan(const QString &field, TSql::SortOrder order) : name(field), descending(order == TSql::DescendingOrder) { }
+        bool operator()(const QSqlRecord &rec1, const QSqlRecord &rec2) const;
+
+        QString name;
+        bool descending;
+    };
+
     Q_DISABLE_COPY(TSqlORMapper)
 
+    const TSqlObjectMetaData *meta;
     QString queryFilter;
     int sortColumn;
     TSql::SortOrder sortOrder;
     int queryLimit;
     int queryOffset;
+    QList<int> projection;
+    QList<Association> associations;
+    bool cacheEnabled;
+    int cacheLifeTime;
+    bool heldResults;
+    QList<QSqlRecord> heldRecords;
+
+    friend class TSqlORMapperCursor<T>;
+    template <class U> friend class TSqlORMapper;
 };
 
 
@@ -61,11 +157,12 @@ private:
 */
 template <class T>
 inline TSqlORMapper<T>::TSqlORMapper()
-    : QSqlTableModel(0, TActionContext::current()->getDatabase(T().databaseId())),
-      sortColumn(-1), sortOrder(TSql::AscendingOrder), queryLimit(0),
-      queryOffset(0)
+    : QSqlTableModel(0, TActionContext::current()->getReadDatabase(T().databaseId())),
+      meta(0), sortColumn(-1), sortOrder(TSql::AscendingOrder), queryLimit(0),
+      queryOffset(0), cacheEnabled(false), cacheLifeTime(0), heldResults(false)
 {
-    setTable(T().tableName());
+    meta = TSqlObjectMetaData::get<T>(database());
+    setTable(meta->tableName());
 }
 
 
@@ -80,18 +177,7 @@ inline TSqlORMapper<T>::~TSqlORMapper()
 template <class T>
 inline T TSqlORMapper<T>::findFirst(const TCriteria &cri)
 {
-    if (!cri.isEmpty()) {
-        TCriteriaConverter<T> conv(cri, database());
-        setFilter(conv.toString());
-    }
-
-    int oldLimit = queryLimit;
-    queryLimit = 1;
-    select();
-    queryLimit = oldLimit;
-
-    tSystemDebug("rowCount: %d", rowCount());
-    return first();
+    return selectFirst(cri);
 }
 
 /*!
@@ -101,18 +187,13 @@ inline T TSqlORMapper<T>::findFirst(const TCriteria &cri)
 template <class T>
 inline T TSqlORMapper<T>::findByPrimaryKey(QVariant pk)
 {
-    int idx = T().primaryKeyIndex();
+    int idx = meta->primaryKeyIndex();
     if (idx < 0) {
-        tSystemDebug("Primary key not found, table name: %s", qPrintable(T().tableName()));
+        tSystemDebug("Primary key not found, table name: %s", qPrintable(meta->tableName()));
         return T();
     }
 
-    TCriteria cri(idx, pk);
-    TCriteriaConverter<T> conv(cri, database());
-    setFilter(conv.toString());
-    select();
-    tSystemDebug("findByPrimaryKey() rowCount: %d", rowCount());
-    return first();
+    return selectFirst(TCriteria(idx, pk));
 }
 
 /*!
@@ -128,13 +209,195 @@ inline int TSqlORMapper<T>::find(const TCriteria &cri)
         TCriteriaConverter<T> conv(cri, database());
         setFilter(conv.toString());
     }
-    if (!select()) {
-        return -1;
+
+    heldResults = false;
+    heldRecords.clear();
+    QList<int> databaseIds = shardDatabaseIds(cri);
+    if (databaseIds.count() > 1) {
+        // Scatter-gather over the shards
+        bool ok;
+        heldRecords = gather(cri, databaseIds, queryLimit, &ok);
+        if (!ok) {
+            return -1;
+        }
+        heldResults = true;
+        loadAssociations();
+        tSystemDebug("rowCount: %d", rowCount());
+        return rowCount();
+    }
+
+    int databaseId = databaseIds.first();
+    QByteArray cacheKey;
+    bool useCache = cacheEnabled && !TActionContext::current()->isDatabaseWritten(databaseId);
+    if (useCache) {
+        cacheKey = TSqlResultCache::key(databaseId, QStringList(meta->tableName()), selectStatement(), QVariantList());
+        heldResults = TSqlResultCache::lookup(cacheKey, heldRecords);
     }
+
+    if (!heldResults) {
+        QSqlDatabase db = readDatabase(databaseId);
+        QElapsedTimer timer;
+        timer.start();
+        bool ok;
+        if (db.connectionName() == database().connectionName()) {
+            ok = select();
+        } else {
+            // Switched to the primary database after a write
+            QSqlTableModel::setQuery(QSqlQuery(selectStatement(), db));
+            ok = query().isActive();
+        }
+        TSqlQueryStatistics::record(query(), timer.nsecsElapsed() / 1000, ok);
+        if (!ok) {
+            return -1;
+        }
+
+        if (useCache) {
+            while (canFetchMore()) {
+                fetchMore();
+            }
+            QList<QSqlRecord> records;
+            for (int i = 0; i < QSqlTableModel::rowCount(); ++i) {
+                records << record(i);
+            }
+            TSqlResultCache::insert(cacheKey, records, cacheLifeTime);
+        }
+    }
+    loadAssociations();
     tSystemDebug("rowCount: %d", rowCount());
     return rowCount();
 }
 
+/*!
+  Retrieves with the criteria \a cri from the table in the background
+  and returns the future of the ORM objects. The sort order, the limit,
+  the offset and the projection of the mapper are applied. The query is
+  executed by TSqlAsyncQuery on another connection, outside the
+  transaction of the action, so that independent queries run
+  concurrently:
+  \code
+  TSqlORMapperFuture<BlogObject> blogs = blogMapper.findAsync(cri);
+  TSqlORMapperFuture<CategoryObject> categories = categoryMapper.findAsync();
+  QList<BlogObject> blogList = blogs.results();  // waits for the query
+  \endcode
+
+  If the query runs on several shards, the results of the shards are
+  concatenated in the order of the shards; the sort order, the limit and
+  the offset are applied to each shard.
+  \sa TSqlAsyncQuery
+*/
+template <class T>
+inline TSqlORMapperFuture<T> TSqlORMapper<T>::findAsync(const TCriteria &cri) const
+{
+    QVariantList values;
+    QString sel = selectStatement(cri, values, queryLimit, queryOffset);
+    QList<int> databaseIds = shardDatabaseIds(cri);
+    QList<QFuture<QList<QSqlRecord> > > futures;
+    for (int i = 0; i < databaseIds.count(); ++i) {
+        futures << TSqlAsyncQuery::exec(sel, values, databaseIds[i]);
+    }
+    return TSqlORMapperFuture<T>(futures);
+}
+
+/*!
+  Returns the number of the rows matching the criteria \a cri by a
+  'SELECT COUNT(*)' statement without retrieving the rows, or -1 if an
+  error occurred. The limit and offset of the mapper are not applied.
+  The rows of all the shards are counted unless \a cri fixes the shard
+  key.
+*/
+template <class T>
+inline int TSqlORMapper<T>::findCount(const TCriteria &cri)
+{
+    QVariantList values;
+    QString sel = QLatin1String("SELECT COUNT(*) FROM ");
+    sel.append(meta->escapedTableName());
+    if (!cri.isEmpty()) {
+        TCriteriaConverter<T> conv(cri, database());
+        QString where = conv.toString(values);
+        if (!where.isEmpty()) {
+            sel.append(QLatin1String(" WHERE ")).append(where);
+        }
+    }
+
+    int cnt = 0;
+    QList<int> databaseIds = shardDatabaseIds(cri);
+    for (int i = 0; i < databaseIds.count(); ++i) {
+        bool ok;
+        QSqlQuery query = TSqlStatementCache::prepare(readDatabase(databaseIds[i]), sel, &ok);
+        ok = ok && TSqlStatementCache::exec(query, values) && query.next();
+        if (ok) {
+            cnt += query.value(0).toInt();
+        }
+        setLastError(query.lastError());
+        query.finish();
+        if (!ok) {
+            return -1;
+        }
+    }
+    return cnt;
+}
+
+/*!
+  Returns true if at least one row matches the criteria \a cri;
+  otherwise returns false. The rows are not retrieved.
+*/
+template <class T>
+inline bool TSqlORMapper<T>::exists(const TCriteria &cri)
+{
+    QVariantList values;
+    QString sel = QLatin1String("SELECT 1 FROM ");
+    sel.append(meta->escapedTableName());
+    if (!cri.isEmpty()) {
+        TCriteriaConverter<T> conv(cri, database());
+        QString where = conv.toString(values);
+        if (!where.isEmpty()) {
+            sel.append(QLatin1String(" WHERE ")).append(where);
+        }
+    }
+    sel.append(QLatin1String(" LIMIT 1"));
+
+    bool res = false;
+    QList<int> databaseIds = shardDatabaseIds(cri);
+    for (int i = 0; i < databaseIds.count() && !res; ++i) {
+        bool ok;
+        QSqlQuery query = TSqlStatementCache::prepare(readDatabase(databaseIds[i]), sel, &ok);
+        res = ok && TSqlStatementCache::exec(query, values) && query.next();
+        setLastError(query.lastError());
+        query.finish();
+    }
+    return res;
+}
+
+/*!
+  Retrieves a page of at most \a limit rows with the criteria \a cri,
+  which follows the row whose value of the property \a column is
+  \a lastValue in the sort order \a order, and returns the number of
+  the ORM objects. If \a lastValue is null, the first page is retrieved.
+
+  Unlike paging with setOffset(), the database seeks the page by the
+  index of \a column, so deep pages cost the same as the first one.
+  The values of \a column must be unique, such as a primary key.
+  \code
+  int cnt = mapper.findAfter(BlogObject::Id, lastId, 20, cri, TSql::DescendingOrder);
+  lastId = mapper.last().id;
+  \endcode
+  \sa find(const TCriteria &)
+*/
+template <class T>
+inline int TSqlORMapper<T>::findAfter(int column, const QVariant &lastValue, int limit, const TCriteria &cri, TSql::SortOrder order)
+{
+    TCriteria pageCri(cri);
+    if (!lastValue.isNull()) {
+        pageCri.add(column, (order == TSql::AscendingOrder) ? TSql::GreaterThan : TSql::LessThan, lastValue);
+    }
+
+    setFilter(QString());
+    setSortOrder(column, order);
+    setLimit(limit);
+    setOffset(0);
+    return find(pageCri);
+}
+
 /*!
   Returns the first ORM object in the results retrieved by find() function.
   \sa find(const TCriteria &)
@@ -165,13 +428,32 @@ inline T TSqlORMapper<T>::value(int i) const
 {
     T rec;
     if (i >= 0 && i < rowCount()) {
-        rec.setRecord(record(i), QSqlError());
+        rec.setRecord(row(i), QSqlError());
     } else {
         tSystemDebug("no such record, index: %d  rowCount:%d", i, rowCount());
     }
     return rec;
 }
 
+/*!
+  Returns the number of the rows retrieved by find() function.
+*/
+template <class T>
+inline int TSqlORMapper<T>::rowCount(const QModelIndex &parent) const
+{
+    return (heldResults) ? heldRecords.count() : QSqlTableModel::rowCount(parent);
+}
+
+/*!
+  Returns the row \a i of the results, which is read from the result
+  cache or the query. This function is for internal use only.
+*/
+template <class T>
+inline QSqlRecord TSqlORMapper<T>::row(int i) const
+{
+    return (heldResults) ? heldRecords.value(i) : record(i);
+}
+
 /*!
   Sets the limit to \a limit, which is the limited number of rows.
 */
@@ -200,6 +482,38 @@ inline void TSqlORMapper<T>::setSortOrder(int column, TSql::SortOrder order)
     sortOrder = order;
 }
 
+/*!
+  Restricts the columns retrieved by the subsequent queries to the
+  properties \a properties, a list of property indexes. The primary key
+  is always retrieved. The other properties of the ORM objects are left
+  with the default values. If \a properties is empty, all the columns
+  are retrieved.
+*/
+template <class T>
+inline void TSqlORMapper<T>::setProjection(const QList<int> &properties)
+{
+    projection = properties;
+    int pk = meta->primaryKeyIndex();
+    if (!projection.isEmpty() && pk >= 0 && !projection.contains(pk)) {
+        projection.prepend(pk);
+    }
+}
+
+/*!
+  Enables the result cache for the subsequent find(), findFirst() and
+  findByPrimaryKey() calls if \a enable is true; otherwise disables it.
+  The results are kept for \a lifeTime seconds, or for
+  TSqlResultCache::defaultLifeTime() seconds if \a lifeTime is 0, unless
+  the table is written before.
+  \sa TSqlResultCache
+*/
+template <class T>
+inline void TSqlORMapper<T>::setResultCache(bool enable, int lifeTime)
+{
+    cacheEnabled = enable;
+    cacheLifeTime = lifeTime;
+}
+
 /*!
   Sets the current filter to \a filter.
   The filter is a SQL WHERE clause without the keyword WHERE (for example,
@@ -219,7 +533,7 @@ inline void TSqlORMapper<T>::setFilter(const QString &filter)
 template <class T>
 inline QString TSqlORMapper<T>::selectStatement() const
 {
-    QString query = QSqlTableModel::selectStatement();
+    QString query = baseSelectStatement();
     if (!queryFilter.isEmpty())
         query.append(QLatin1String(" WHERE ")).append(queryFilter);
 
@@ -234,7 +548,6 @@ inline QString TSqlORMapper<T>::selectStatement() const
     if (queryOffset > 0) {
         query.append(QLatin1String(" OFFSET ")).append(QString::number(queryOffset));
     }
-    tQueryLog("%s", qPrintable(query));
     return query;
 }
 
@@ -246,7 +559,7 @@ template <class T>
 inline int TSqlORMapper<T>::removeAll(const TCriteria &cri)
 {
     QString del = database().driver()->sqlStatement(QSqlDriver::DeleteStatement,
-                                                    T().tableName(), QSqlRecord(), false);
+                                                    meta->escapedTableName(), QSqlRecord(), false);
     TCriteriaConverter<T> conv(cri, database());
     QString where = conv.toString();
 
@@ -258,13 +571,267 @@ inline int TSqlORMapper<T>::removeAll(const TCriteria &cri)
         del.append(QLatin1String(" WHERE ")).append(where);
     }
 
-    tQueryLog("%s", qPrintable(del));
-  
-    QSqlQuery sqlQuery(database());
-    if ( !sqlQuery.exec(del) ) {
+    int res = 0;
+    QList<int> databaseIds = shardDatabaseIds(cri);
+    for (int i = 0; i < databaseIds.count(); ++i) {
+        QSqlDatabase db = writeDatabase(databaseIds[i]);
+        TActionContext::current()->beginTransaction(db);
+        TActionContext::current()->invalidateResultCache(meta->tableName());
+        QSqlQuery sqlQuery(db);
+        if (!TSqlQueryStatistics::exec(sqlQuery, del)) {
+            return -1;
+        }
+        res += sqlQuery.numRowsAffected();
+    }
+    return res;
+}
+
+/*!
+  Updates the rows based on the criteria \a cri with the \a values, a map
+  of property indexes to new values, by one UPDATE statement and returns
+  the number of the rows affected by the query executed, or -1 if an error
+  occurred. The 'updated_at' or 'modified_at' property is set to the
+  current date and time unless it is in \a values, and the
+  'lock_revision' property is incremented.
+*/
+template <class T>
+inline int TSqlORMapper<T>::updateAll(const TCriteria &cri, const QMap<int, QVariant> &values)
+{
+    if (values.isEmpty()) {
+        tWarn("No values to update");
+        return -1;
+    }
+
+    QList<int> databaseIds = shardDatabaseIds(cri);
+    QSqlDatabase db = writeDatabase(databaseIds.first());
+    QString upd;   // UPDATE Statement
+    QVariantList binds;
+    upd.reserve(256);
+    upd.append(QLatin1String("UPDATE ")).append(meta->escapedTableName()).append(QLatin1String(" SET "));
+
+    for (QMapIterator<int, QVariant> it(values); it.hasNext(); ) {
+        it.next();
+        QString name = meta->escapedPropertyName(it.key());
+        if (name.isEmpty()) {
+            tError("Invalid property index: %d", it.key());
+            return -1;
+        }
+        upd.append(name);
+        upd.append(QLatin1String("=?, "));
+        binds << it.value();
+    }
+
+    // Updates the value of 'updated_at' or 'modified_at' property
+    QDateTime now = QDateTime::currentDateTime();
+    int timestamps[] = { meta->updatedAtIndex(), meta->modifiedAtIndex() };
+    for (int i = 0; i < 2; ++i) {
+        if (timestamps[i] >= 0 && !values.contains(timestamps[i])) {
+            upd.append(meta->escapedPropertyName(timestamps[i]));
+            upd.append(QLatin1String("=?, "));
+            binds << now;
+        }
+    }
+
+    // Increments the value of 'lock_revision' property
+    int revision = meta->revisionIndex();
+    if (revision >= 0 && !values.contains(revision)) {
+        QString rev = meta->escapedPropertyName(revision);
+        upd.append(rev).append(QLatin1Char('=')).append(rev).append(QLatin1String("+1, "));
+    }
+    upd.chop(2);
+
+    TCriteriaConverter<T> conv(cri, db);
+    QString where = conv.toString(binds);
+    if (!where.isEmpty()) {
+        upd.append(QLatin1String(" WHERE ")).append(where);
+    }
+
+    int res = 0;
+    for (int i = 0; i < databaseIds.count(); ++i) {
+        db = writeDatabase(databaseIds[i]);
+        TActionContext::current()->beginTransaction(db);
+        TActionContext::current()->invalidateResultCache(meta->tableName());
+
+        bool ok;
+        QSqlQuery query = TSqlStatementCache::prepare(db, upd, &ok);
+        if (ok) {
+            ok = TSqlStatementCache::exec(query, binds);
+        }
+        setLastError(query.lastError());
+        if (ok) {
+            res += query.numRowsAffected();
+        }
+        query.finish();
+        if (!ok) {
+            return -1;
+        }
+    }
+    return res;
+}
+
+/*!
+  Inserts the ORM objects \a objects into the table and returns the
+  number of the rows inserted, or -1 if an error occurred. The values of
+  the 'lock_revision', 'created_at', 'updated_at' and 'modified_at'
+  properties are set as TSqlObject::create() does.
+
+  The rows are inserted with a batch execution if the driver supports it,
+  otherwise with multi-row INSERT statements, each chunk binding at most
+  as many values as the database accepts. If \a generatedIds is not 0,
+  the values of the auto-value field are appended to it in the order of
+  \a objects; unless the database returns them for a multi-row INSERT,
+  the rows are inserted one by one with a single prepared statement.
+*/
+template <class T>
+inline int TSqlORMapper<T>::insertAll(const QList<T> &objects, QVariantList *generatedIds)
+{
+    if (objects.isEmpty()) {
+        return 0;
+    }
+
+    // Groups the rows by the database holding them
+    QMap<int, QList<QSqlRecord> > records;
+    QMap<int, QList<int> > indexes;
+    for (int i = 0; i < objects.count(); ++i) {
+        T obj = objects[i];
+        QSqlRecord rec = obj.recordToCreate();
+        int id = obj.shardDatabaseId();
+        records[id] << rec;
+        indexes[id] << i;
+    }
+
+    if (records.count() == 1) {
+        return insertRecords(records.begin().key(), records.begin().value(), generatedIds);
+    }
+
+    int res = 0;
+    QVector<QVariant> ids(objects.count());
+    for (QMapIterator<int, QList<QSqlRecord> > it(records); it.hasNext(); ) {
+        it.next();
+        QVariantList shardIds;
+        int cnt = insertRecords(it.key(), it.value(), (generatedIds) ? &shardIds : 0);
+        if (cnt < 0) {
+            return -1;
+        }
+        res += cnt;
+
+        const QList<int> &idx = indexes[it.key()];
+        for (int i = 0; i < shardIds.count() && i < idx.count(); ++i) {
+            ids[idx[i]] = shardIds[i];
+        }
+    }
+
+    if (generatedIds) {
+        *generatedIds << ids.toList();
+    }
+    return res;
+}
+
+/*!
+  Inserts the records \a records into the table of the database
+  \a databaseId, as insertAll() does.
+  This function is for internal use only.
+*/
+template <class T>
+inline int TSqlORMapper<T>::insertRecords(int databaseId, const QList<QSqlRecord> &records, QVariantList *generatedIds)
+{
+    const QSqlRecord &first = records.first();
+    QSqlDatabase db = writeDatabase(databaseId);
+    TActionContext::current()->beginTransaction(db);
+    TActionContext::current()->invalidateResultCache(meta->tableName());
+    QString ins = db.driver()->sqlStatement(QSqlDriver::InsertStatement, meta->escapedTableName(), first, true);
+    if (ins.isEmpty()) {
+        tSystemError("Statement Error");
         return -1;
     }
-    return sqlQuery.numRowsAffected();
+
+    int columns = first.count();
+    QString autoName = meta->escapedPropertyName(meta->autoValueIndex());
+    QString driverName = db.driverName().toUpper();
+    bool multiRow = (driverName.startsWith("QSQLITE") || driverName.startsWith("QMYSQL") || driverName.startsWith("QPSQL"));
+    bool returning = (generatedIds && !autoName.isEmpty() && driverName.startsWith("QPSQL"));
+    int res = 0;
+
+    if (generatedIds && !autoName.isEmpty() && !returning) {
+        // Executes the prepared statement for each row to get the generated ids
+        bool ok;
+        QSqlQuery query = TSqlStatementCache::prepare(db, ins, &ok);
+        for (int i = 0; ok && i < records.count(); ++i) {
+            QVariantList values;
+            for (int c = 0; c < columns; ++c) {
+                values << records[i].value(c);
+            }
+            ok = TSqlStatementCache::exec(query, values);
+            if (ok) {
+                *generatedIds << query.lastInsertId();
+                ++res;
+            }
+        }
+        setLastError(query.lastError());
+        query.finish();
+        return (ok) ? res : -1;
+    }
+
+    if (!multiRow || db.driver()->hasFeature(QSqlDriver::BatchOperations)) {
+        // Batch execution
+        bool ok;
+        QSqlQuery query = TSqlStatementCache::prepare(db, ins, &ok);
+        if (ok) {
+            for (int c = 0; c < columns; ++c) {
+                QVariantList values;
+                for (int i = 0; i < records.count(); ++i) {
+                    values << records[i].value(c);
+                }
+                query.bindValue(c, values);
+            }
+            ok = TSqlQueryStatistics::execBatch(query);
+        }
+        setLastError(query.lastError());
+        query.finish();
+        return (ok) ? records.count() : -1;
+    }
+
+    // Multi-row INSERT statements
+    int maxValues = (driverName.startsWith("QSQLITE")) ? 999 : 65535;
+    int chunkSize = qBound(1, maxValues / qMax(columns, 1), 500);
+    QString tuple = ins.mid(ins.lastIndexOf(QLatin1String(" VALUES ")) + 8);
+
+    for (int i = 0; i < records.count(); i += chunkSize) {
+        int rows = qMin(chunkSize, records.count() - i);
+        QString stmt = ins;
+        QVariantList values;
+        for (int r = 0; r < rows; ++r) {
+            if (r > 0) {
+                stmt.append(QLatin1String(", ")).append(tuple);
+            }
+            for (int c = 0; c < columns; ++c) {
+                values << records[i + r].value(c);
+            }
+        }
+        if (returning) {
+            stmt.append(QLatin1String(" RETURNING ")).append(autoName);
+        }
+
+        bool ok;
+        QSqlQuery query = TSqlStatementCache::prepare(db, stmt, &ok);
+        if (ok) {
+            ok = TSqlStatementCache::exec(query, values);
+        }
+        if (!ok) {
+            setLastError(query.lastError());
+            query.finish();
+            return -1;
+        }
+
+        if (returning && generatedIds) {
+            while (query.next()) {
+                *generatedIds << query.value(0);
+            }
+        }
+        query.finish();
+        res += rows;
+    }
+    return res;
 }
 
 /*!
@@ -288,11 +855,445 @@ inline void TSqlORMapper<T>::clear()
     sortOrder = TSql::AscendingOrder;
     queryLimit = 0;
     queryOffset = 0;
+    projection.clear();
+    associations.clear();
+    cacheEnabled = false;
+    cacheLifeTime = 0;
+    heldResults = false;
+    heldRecords.clear();
     
     // Don't call the setTable() here,
     // or it causes a segmentation fault.
 }
 
+/*!
+  Returns a SELECT statement without WHERE clause, for the columns set
+  by setProjection() or all the columns of the table.
+  This function is for internal use only.
+*/
+template <class T>
+inline QString TSqlORMapper<T>::baseSelectStatement() const
+{
+    if (projection.isEmpty()) {
+        return QSqlTableModel::selectStatement();
+    }
+
+    QString sel = QLatin1String("SELECT ");
+    for (QListIterator<int> it(projection); it.hasNext(); ) {
+        QString name = meta->escapedPropertyName(it.next());
+        if (!name.isEmpty()) {
+            sel.append(name).append(QLatin1String(", "));
+        }
+    }
+    sel.chop(2);
+    sel.append(QLatin1String(" FROM ")).append(meta->escapedTableName());
+    return sel;
+}
+
+/*!
+  Returns a SELECT statement with the criteria \a cri, the sort order,
+  the limit \a limit and the offset \a offset, in which the values of
+  the criteria are replaced with '?' placeholders and appended to
+  \a values. This function is for internal use only.
+*/
+template <class T>
+inline QString TSqlORMapper<T>::selectStatement(const TCriteria &cri, QVariantList &values, int limit, int offset) const
+{
+    QString sel = baseSelectStatement();
+    if (sel.isEmpty()) {
+        tSystemError("Statement Error");
+        return sel;
+    }
+
+    if (!cri.isEmpty()) {
+        TCriteriaConverter<T> conv(cri, database());
+        QString where = conv.toString(values);
+        if (!where.isEmpty()) {
+            sel.append(QLatin1String(" WHERE ")).append(where);
+        }
+    }
+
+    sel.append(orderByClause());
+    if (limit > 0) {
+        sel.append(QLatin1String(" LIMIT ")).append(QString::number(limit));
+    }
+    if (offset > 0) {
+        sel.append(QLatin1String(" OFFSET ")).append(QString::number(offset));
+    }
+    return sel;
+}
+
+/*!
+  Executes a SELECT statement with the criteria \a cri limited to one row
+  and returns the ORM object. The statement is prepared with placeholders
+  and kept in the statement cache of the connection, so that only the
+  values are sent on subsequent calls.
+*/
+template <class T>
+inline T TSqlORMapper<T>::selectFirst(const TCriteria &cri)
+{
+    T obj;
+    QList<int> databaseIds = shardDatabaseIds(cri);
+    if (databaseIds.count() > 1) {
+        // Scatter-gather over the shards
+        bool ok;
+        QList<QSqlRecord> records = gather(cri, databaseIds, 1, &ok);
+        if (!records.isEmpty()) {
+            obj.setRecord(records.first(), QSqlError());
+        }
+        return obj;
+    }
+
+    int databaseId = databaseIds.first();
+    QVariantList values;
+    QString sel = selectStatement(cri, values, 1, queryOffset);
+    if (sel.isEmpty()) {
+        return obj;
+    }
+
+    QList<QSqlRecord> records;
+    QByteArray cacheKey;
+    bool useCache = cacheEnabled && !TActionContext::current()->isDatabaseWritten(databaseId);
+    if (useCache) {
+        cacheKey = TSqlResultCache::key(databaseId, QStringList(meta->tableName()), sel, values);
+    }
+    if (useCache && TSqlResultCache::lookup(cacheKey, records)) {
+        if (!records.isEmpty()) {
+            obj.setRecord(records.first(), QSqlError());
+        }
+        return obj;
+    }
+
+    bool ok;
+    QSqlQuery query = TSqlStatementCache::prepare(readDatabase(databaseId), sel, &ok);
+    if (ok && TSqlStatementCache::exec(query, values)) {
+        if (query.next()) {
+            obj.setRecord(query.record(), QSqlError());
+            records << query.record();
+        }
+        if (useCache) {
+            TSqlResultCache::insert(cacheKey, records, cacheLifeTime);
+        }
+    }
+    query.finish();
+    return obj;
+}
+
+/*!
+  Retrieves the rows with the criteria \a cri from each database of
+  \a databaseIds, merges them in the sort order and returns at most
+  \a limit rows following the offset. Each database is queried for the
+  rows up to the offset plus the limit, so that the page is complete.
+  If \a ok is not 0, *ok is set to false if an error occurred.
+  This function is for internal use only.
+*/
+template <class T>
+inline QList<QSqlRecord> TSqlORMapper<T>::gather(const TCriteria &cri, const QList<int> &databaseIds, int limit, bool *ok)
+{
+    QList<QSqlRecord> records;
+    QVariantList values;
+    QString sel = selectStatement(cri, values, (limit > 0) ? limit + queryOffset : 0, 0);
+    bool res = !sel.isEmpty();
+
+    for (int i = 0; res && i < databaseIds.count(); ++i) {
+        QSqlQuery query = TSqlStatementCache::prepare(readDatabase(databaseIds[i]), sel, &res);
+        if (res && TSqlStatementCache::exec(query, values)) {
+            while (query.next()) {
+                records << query.record();
+            }
+        } else {
+            res = false;
+        }
+        setLastError(query.lastError());
+        query.finish();
+    }
+
+    if (ok) {
+        *ok = res;
+    }
+    if (!res) {
+        return QList<QSqlRecord>();
+    }
+
+    if (sortColumn >= 0 && databaseIds.count() > 1) {
+        qStableSort(records.begin(), records.end(), RecordLessThan(meta->propertyName(sortColumn), sortOrder));
+    }
+    return records.mid(queryOffset, (limit > 0) ? limit : -1);
+}
+
+/*!
+  Returns the IDs of the databases to run a query with the criteria
+  \a cri, which are the shard of the value of the shard key in \a cri,
+  or all the shards if \a cri does not fix the shard key.
+  This function is for internal use only.
+*/
+template <class T>
+inline QList<int> TSqlORMapper<T>::shardDatabaseIds(const TCriteria &cri) const
+{
+    QList<int> ids;
+    TSqlDatabasePool *pool = TSqlDatabasePool::instance();
+    int shards = pool->shardCount(meta->databaseId());
+    if (meta->shardKeyIndex() < 0 || shards <= 1) {
+        ids << meta->databaseId();
+        return ids;
+    }
+
+    QVariant key = TCriteriaConverter<T>::equalValue(cri, meta->shardKeyIndex());
+    if (!key.isNull()) {
+        ids << pool->shardDatabaseId(meta->databaseId(), pool->shardOf(meta->databaseId(), key, meta->shardKeyType()));
+    } else {
+        for (int i = 0; i < shards; ++i) {
+            ids << pool->shardDatabaseId(meta->databaseId(), i);
+        }
+    }
+    return ids;
+}
+
+/*!
+  Compares the values of the sort field of the records \a rec1 and
+  \a rec2 in the sort order. Null values come first in ascending order.
+*/
+template <class T>
+inline bool TSqlORMapper<T>::RecordLessThan::operator()(const QSqlRecord &rec1, const QSqlRecord &rec2) const
+{
+    QVariant v1 = rec1.value(name);
+    QVariant v2 = rec2.value(name);
+    int cmp;
+
+    if (v1.isNull() || v2.isNull()) {
+        cmp = (int)!v1.isNull() - (int)!v2.isNull();
+    } else {
+        switch (v1.type()) {
+        case QVariant::Int:
+        case QVariant::UInt:
+        case QVariant::LongLong:
+        case QVariant::ULongLong:
+        case QVariant::Double:
+            cmp = (v1.toDouble() < v2.toDouble()) ? -1 : (v1.toDouble() > v2.toDouble()) ? 1 : 0;
+            break;
+
+        case QVariant::Date:
+        case QVariant::DateTime:
+            cmp = (v1.toDateTime() < v2.toDateTime()) ? -1 : (v1.toDateTime() > v2.toDateTime()) ? 1 : 0;
+            break;
+
+        case QVariant::Time:
+            cmp = (v1.toTime() < v2.toTime()) ? -1 : (v1.toTime() > v2.toTime()) ? 1 : 0;
+            break;
+
+        default:
+            cmp = QString::compare(v1.toString(), v2.toString());
+            break;
+        }
+    }
+    return (descending) ? cmp > 0 : cmp < 0;
+}
+
+/*!
+  Loads the objects of the class \a R which the retrieved objects belong
+  to, i.e. whose primary key equals the property \a foreignKey of the
+  objects, by one query per find() call.
+  \sa belongsTo()
+*/
+template <class T>
+template <class R>
+inline void TSqlORMapper<T>::includeBelongsTo(int foreignKey)
+{
+    Association assoc;
+    assoc.related = &R::staticMetaObject;
+    assoc.localColumn = foreignKey;
+    assoc.relatedColumn = TSqlObjectMetaData::get<R>(database())->primaryKeyIndex();
+    assoc.load = &TSqlORMapper<T>::template loadRecords<R>;
+    associations << assoc;
+}
+
+/*!
+  Loads the objects of the class \a R which the retrieved objects have,
+  i.e. whose property \a relatedForeignKey equals the primary key of
+  the objects, by one query per find() call.
+  \sa hasMany()
+*/
+template <class T>
+template <class R>
+inline void TSqlORMapper<T>::includeHasMany(int relatedForeignKey)
+{
+    Association assoc;
+    assoc.related = &R::staticMetaObject;
+    assoc.localColumn = meta->primaryKeyIndex();
+    assoc.relatedColumn = relatedForeignKey;
+    assoc.load = &TSqlORMapper<T>::template loadRecords<R>;
+    associations << assoc;
+}
+
+/*!
+  Returns the object of the class \a R which the \a object belongs to
+  by the property \a foreignKey. If the association has not been
+  included by includeBelongsTo(), the object is retrieved now.
+*/
+template <class T>
+template <class R>
+inline R TSqlORMapper<T>::belongsTo(const T &object, int foreignKey) const
+{
+    R obj;
+    int pk = TSqlObjectMetaData::get<R>(database())->primaryKeyIndex();
+    QVariant key = object.readProperty(foreignKey);
+    if (key.isNull() || pk < 0) {
+        return obj;
+    }
+
+    const Association *assoc = association(&R::staticMetaObject, foreignKey, pk);
+    if (assoc) {
+        QList<QSqlRecord> recs = assoc->records.value(key.toString());
+        if (!recs.isEmpty()) {
+            obj.setRecord(recs.first(), QSqlError());
+        }
+    } else {
+        TSqlORMapper<R> mapper;
+        obj = mapper.findByPrimaryKey(key);
+    }
+    return obj;
+}
+
+/*!
+  Returns the list of the objects of the class \a R whose property
+  \a relatedForeignKey refers to the \a object. If the association has
+  not been included by includeHasMany(), the objects are retrieved now.
+*/
+template <class T>
+template <class R>
+inline QList<R> TSqlORMapper<T>::hasMany(const T &object, int relatedForeignKey) const
+{
+    QList<R> list;
+    QVariant key = object.readProperty(meta->primaryKeyIndex());
+    if (key.isNull()) {
+        return list;
+    }
+
+    const Association *assoc = association(&R::staticMetaObject, meta->primaryKeyIndex(), relatedForeignKey);
+    if (assoc) {
+        QList<QSqlRecord> recs = assoc->records.value(key.toString());
+        for (QListIterator<QSqlRecord> it(recs); it.hasNext(); ) {
+            R obj;
+            obj.setRecord(it.next(), QSqlError());
+            list << obj;
+        }
+    } else {
+        TSqlORMapper<R> mapper;
+        mapper.find(TCriteria(relatedForeignKey, key));
+        while (mapper.canFetchMore()) {
+            mapper.fetchMore();
+        }
+        for (int i = 0; i < mapper.rowCount(); ++i) {
+            list << mapper.value(i);
+        }
+    }
+    return list;
+}
+
+/*!
+  Loads the included associations of the retrieved objects.
+  This function is for internal use only.
+*/
+template <class T>
+inline void TSqlORMapper<T>::loadAssociations()
+{
+    if (associations.isEmpty()) {
+        return;
+    }
+
+    // Collects the keys of all the rows, not only the prefetched ones
+    while (!heldResults && canFetchMore()) {
+        fetchMore();
+    }
+
+    for (int i = 0; i < associations.count(); ++i) {
+        Association &assoc = associations[i];
+        assoc.records.clear();
+
+        // Collects the keys
+        QString name = meta->propertyName(assoc.localColumn);
+        QVariantList keys;
+        QSet<QString> found;
+        for (int j = 0; j < rowCount(); ++j) {
+            QVariant key = row(j).value(name);
+            if (!key.isNull() && !found.contains(key.toString())) {
+                found.insert(key.toString());
+                keys << key;
+            }
+        }
+
+        if (!keys.isEmpty()) {
+            assoc.load(assoc.relatedColumn, keys, assoc.records);
+        }
+    }
+}
+
+/*!
+  Returns the included association to the class \a related, or 0 if not
+  included. This function is for internal use only.
+*/
+template <class T>
+inline const typename TSqlORMapper<T>::Association *TSqlORMapper<T>::association(const QMetaObject *related, int localColumn, int relatedColumn) const
+{
+    for (int i = 0; i < associations.count(); ++i) {
+        const Association &assoc = associations[i];
+        if (assoc.related == related && assoc.localColumn == localColumn && assoc.relatedColumn == relatedColumn) {
+            return &assoc;
+        }
+    }
+    return 0;
+}
+
+/*!
+  Retrieves the rows of the class \a R whose property \a column is one
+  of the \a keys, by 'IN (...)' queries of up to 500 keys, and adds them
+  to \a records keyed by the value of \a column.
+  This function is for internal use only.
+*/
+template <class T>
+template <class R>
+inline void TSqlORMapper<T>::loadRecords(int column, const QVariantList &keys, RecordHash &records)
+{
+    const int maxKeys = 500;
+    TSqlORMapper<R> mapper;
+    QString name = TSqlObjectMetaData::get<R>(mapper.database())->propertyName(column);
+
+    for (int i = 0; i < keys.count(); i += maxKeys) {
+        if (mapper.find(TCriteria(column, TSql::In, QVariant(keys.mid(i, maxKeys)))) < 0) {
+            continue;
+        }
+        while (mapper.canFetchMore()) {
+            mapper.fetchMore();
+        }
+        for (int j = 0; j < mapper.rowCount(); ++j) {
+            QSqlRecord rec = mapper.row(j);  // held for sharded classes
+            records[rec.value(name).toString()] << rec;
+        }
+    }
+}
+
+/*!
+  Returns the connection for reading to the database \a databaseId,
+  which is the database of the class or one of its shards. It is a
+  replica unless the current action has written to the database.
+  This function is for internal use only.
+*/
+template <class T>
+inline QSqlDatabase TSqlORMapper<T>::readDatabase(int databaseId) const
+{
+    return TActionContext::current()->getReadDatabase(databaseId);
+}
+
+/*!
+  Returns the connection for writing to the database \a databaseId.
+  This function is for internal use only.
+*/
+template <class T>
+inline QSqlDatabase TSqlORMapper<T>::writeDatabase(int databaseId) const
+{
+    return TActionContext::current()->getDatabase(databaseId);
+}
+
 /*!
   Returns a SQL WHERE clause generated from a criteria.
 */
@@ -301,9 +1302,8 @@ inline QString TSqlORMapper<T>::orderByClause() const
 {
     QString str;
     if (sortColumn >= 0) {
-        QString f = TCriteriaConverter<T>::propertyName(sortColumn);
-        if (!f.isEmpty()) {
-            QString field = TSqlQuery::escapeIdentifier(f, QSqlDriver::FieldName, database());
+        QString field = meta->escapedPropertyName(sortColumn);
+        if (!field.isEmpty()) {
             str.append(QLatin1String(" ORDER BY ")).append(field);
             str.append((sortOrder == TSql::AscendingOrder) ? QLatin1String(" ASC") : QLatin1String(" DESC"));
         }
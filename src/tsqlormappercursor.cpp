@@ -0,0 +1,63 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <TSqlORMapperCursor>
+
+/*!
+  \class TSqlORMapperCursor
+  \brief The TSqlORMapperCursor class provides a forward-only cursor
+         which retrieves ORM objects from a table one row at a time.
+
+  Unlike TSqlORMapper::find() and TSqlORMapperIterator, the rows are not
+  buffered in the mapper, so a large table can be iterated in constant
+  memory. The sort order, limit and offset of the mapper are applied.
+  \code
+  TSqlORMapper<BlogObject> mapper;
+  TSqlORMapperCursor<BlogObject> cursor(mapper, TCriteria(BlogObject::Status, 1));
+  BlogObject blog;
+  while (cursor.next(blog)) {
+      ...
+  }
+  \endcode
+  \sa TSqlORMapper, TSqlORMapperIterator
+*/
+
+/*!
+  \fn TSqlORMapperCursor<T>::TSqlORMapperCursor(const TSqlORMapper<T> &mapper, const TCriteria &cri)
+  Constructor. Executes a SELECT statement with the criteria \a cri on
+  the table of the \a mapper.
+*/
+
+/*!
+  \fn bool TSqlORMapperCursor<T>::isActive() const
+  Returns true if the SELECT statement was executed successfully and the
+  cursor is not finished; otherwise returns false.
+*/
+
+/*!
+  \fn bool TSqlORMapperCursor<T>::hasNext()
+  Returns true if there is at least one object ahead of the cursor;
+  otherwise returns false. The row is fetched from the database.
+*/
+
+/*!
+  \fn T TSqlORMapperCursor<T>::next()
+  Returns the next object and advances the cursor by one position.
+  If there is no object ahead, returns an empty object.
+*/
+
+/*!
+  \fn bool TSqlORMapperCursor<T>::next(T &object)
+  Populates the \a object with the next row and advances the cursor by
+  one position. Returns false if there is no object ahead. Passing the
+  same object on every call avoids constructing an object per row.
+*/
+
+/*!
+  \fn QSqlError TSqlORMapperCursor<T>::lastError() const
+  Returns information about the last error that occurred on the query.
+*/
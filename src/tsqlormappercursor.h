@@ -0,0 +1,106 @@
+#ifndef TSQLORMAPPERCURSOR_H
+#define TSQLORMAPPERCURSOR_H
+
+#include <TSqlORMapper>
+
+
+template <class T>
+class TSqlORMapperCursor
+{
+public:
+    TSqlORMapperCursor(const TSqlORMapper<T> &mapper, const TCriteria &cri = TCriteria());
+    ~TSqlORMapperCursor() { query.finish(); }
+
+    bool isActive() const { return query.isActive(); }
+    bool hasNext();
+    T next();
+    bool next(T &object);
+    QSqlError lastError() const { return query.lastError(); }
+
+private:
+    TSqlORMapperCursor(const TSqlORMapperCursor<T> &);
+    TSqlORMapperCursor<T> &operator=(const TSqlORMapperCursor<T> &);
+    bool exec(const QSqlDatabase &database);
+
+    QSqlQuery query;
+    QString statement;
+    QVariantList values;
+    QList<QSqlDatabase> databases;  // shards not queried yet
+    bool fetched;
+    bool available;
+};
+
+
+/*
+  If the class is sharded and the criteria does not fix the shard key,
+  the shards are read one after another; the sort order and the limit
+  are applied to each shard.
+*/
+template <class T>
+inline TSqlORMapperCursor<T>::TSqlORMapperCursor(const TSqlORMapper<T> &mapper, const TCriteria &cri)
+    : fetched(false), available(false)
+{
+    statement = mapper.selectStatement(cri, values, mapper.queryLimit, mapper.queryOffset);
+    if (statement.isEmpty()) {
+        return;
+    }
+
+    QList<int> databaseIds = mapper.shardDatabaseIds(cri);
+    for (int i = 0; i < databaseIds.count(); ++i) {
+        databases << mapper.readDatabase(databaseIds[i]);
+    }
+    exec(databases.takeFirst());
+}
+
+
+template <class T>
+inline bool TSqlORMapperCursor<T>::exec(const QSqlDatabase &database)
+{
+    query = QSqlQuery(database);
+    // Rows are not cached by the result object
+    query.setForwardOnly(true);
+    if (!query.prepare(statement)) {
+        tSystemError("SQL prepare error: %s", qPrintable(query.lastError().text()));
+        return false;
+    }
+    return TSqlStatementCache::exec(query, values);
+}
+
+
+template <class T>
+inline bool TSqlORMapperCursor<T>::hasNext()
+{
+    if (!fetched) {
+        available = query.isActive() && query.next();
+        while (!available && !databases.isEmpty()) {
+            // Continues to the next shard
+            query.finish();
+            available = exec(databases.takeFirst()) && query.next();
+        }
+        fetched = true;
+    }
+    return available;
+}
+
+
+template <class T>
+inline T TSqlORMapperCursor<T>::next()
+{
+    T obj;
+    next(obj);
+    return obj;
+}
+
+
+template <class T>
+inline bool TSqlORMapperCursor<T>::next(T &object)
+{
+    if (!hasNext()) {
+        return false;
+    }
+    fetched = false;
+    object.setRecord(query.record(), QSqlError());
+    return true;
+}
+
+#endif // TSQLORMAPPERCURSOR_H
@@ -0,0 +1,62 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <TSqlORMapperFuture>
+
+/*!
+  \class TSqlORMapperFuture
+  \brief The TSqlORMapperFuture class represents the ORM objects which
+         are retrieved in the background by TSqlORMapper::findAsync().
+
+  The functions returning the results wait until the query is finished.
+  The ORM objects are created in the calling thread.
+  \sa TSqlAsyncQuery
+*/
+
+/*!
+  \fn TSqlORMapperFuture<T>::TSqlORMapperFuture(const QFuture<QList<QSqlRecord> > &future)
+  Constructs a TSqlORMapperFuture object with the future \a future of
+  the rows.
+*/
+
+/*!
+  \fn TSqlORMapperFuture<T>::TSqlORMapperFuture(const QList<QFuture<QList<QSqlRecord> > > &futures)
+  Constructs a TSqlORMapperFuture object with the futures \a futures of
+  the rows of the shards, which are concatenated in order.
+*/
+
+/*!
+  \fn bool TSqlORMapperFuture<T>::isFinished() const
+  Returns true if the queries are finished; otherwise returns false.
+*/
+
+/*!
+  \fn void TSqlORMapperFuture<T>::waitForFinished()
+  Waits for the queries to finish.
+*/
+
+/*!
+  \fn bool TSqlORMapperFuture<T>::hasError()
+  Waits for the queries to finish, and returns true if any of them
+  failed; otherwise returns false. The results of a failed query are
+  empty.
+*/
+
+/*!
+  \fn int TSqlORMapperFuture<T>::count()
+  Returns the number of the ORM objects retrieved.
+*/
+
+/*!
+  \fn T TSqlORMapperFuture<T>::first()
+  Returns the first ORM object retrieved, or an empty object if none.
+*/
+
+/*!
+  \fn QList<T> TSqlORMapperFuture<T>::results()
+  Returns the ORM objects retrieved.
+*/
@@ -0,0 +1,104 @@
+#ifndef TSQLORMAPPERFUTURE_H
+#define TSQLORMAPPERFUTURE_H
+
+#include <QFuture>
+#include <QList>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <TSqlAsyncQuery>
+
+
+template <class T>
+class TSqlORMapperFuture
+{
+public:
+    TSqlORMapperFuture(const QFuture<QList<QSqlRecord> > &future) { fs << future; }
+    TSqlORMapperFuture(const QList<QFuture<QList<QSqlRecord> > > &futures) : fs(futures) { }
+
+    bool isFinished() const;
+    void waitForFinished();
+    bool hasError();
+    int count() { return records().count(); }
+    T first();
+    QList<T> results();
+
+private:
+    QList<QSqlRecord> records();
+
+    QList<QFuture<QList<QSqlRecord> > > fs;
+};
+
+
+template <class T>
+inline bool TSqlORMapperFuture<T>::isFinished() const
+{
+    for (int i = 0; i < fs.count(); ++i) {
+        if (!fs[i].isFinished())
+            return false;
+    }
+    return true;
+}
+
+
+template <class T>
+inline void TSqlORMapperFuture<T>::waitForFinished()
+{
+    for (int i = 0; i < fs.count(); ++i) {
+        fs[i].waitForFinished();
+    }
+}
+
+
+template <class T>
+inline bool TSqlORMapperFuture<T>::hasError()
+{
+    for (int i = 0; i < fs.count(); ++i) {
+        fs[i].waitForFinished();
+        if (fs[i].isCanceled())
+            return true;
+    }
+    return false;
+}
+
+
+template <class T>
+inline T TSqlORMapperFuture<T>::first()
+{
+    T obj;
+    QList<QSqlRecord> recs = records();
+    if (!recs.isEmpty()) {
+        obj.setRecord(recs.first(), QSqlError());
+    }
+    return obj;
+}
+
+
+template <class T>
+inline QList<T> TSqlORMapperFuture<T>::results()
+{
+    QList<T> list;
+    QList<QSqlRecord> recs = records();
+    for (QListIterator<QSqlRecord> it(recs); it.hasNext(); ) {
+        T obj;
+        obj.setRecord(it.next(), QSqlError());
+        list << obj;
+    }
+    return list;
+}
+
+
+template <class T>
+inline QList<QSqlRecord> TSqlORMapperFuture<T>::records()
+{
+    if (fs.count() == 1) {
+        return fs.first().result();
+    }
+
+    QList<QSqlRecord> recs;
+    for (int i = 0; i < fs.count(); ++i) {
+        recs << fs[i].result();
+    }
+    return recs;
+}
+
+#endif // TSQLORMAPPERFUTURE_H
@@ -6,15 +6,101 @@
  */
 
 #include <QHash>
-#include <QMutex>
-#include <QMutexLocker>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QDateTime>
+#include <QFileInfo>
 #include <TSqlQuery>
+#include <TSqlQueryStatistics>
+#include <TSqlStatementCache>
 #include <TWebApplication>
 #include <TActionContext>
+#include <TSqlDatabasePool>
 #include "tsystemglobal.h"
 
-static QHash<QString, QString> queryCache;
-static QMutex cacheMutex;
+#define CHECK_INTERVAL_KEY  "SqlQueriesCheckInterval"
+
+
+struct QueryFile
+{
+    QString query;
+    QDateTime modified;
+    uint checkedAt;
+};
+
+static QHash<QString, QueryFile> queryCache;  // key: file name
+static QReadWriteLock cacheLock;
+
+
+/*
+  Returns the SQL query in the file \a filename of the directory
+  \a dirPath. The query is read again if the file has been modified,
+  which is checked at most once in the interval of the application
+  setting \a SqlQueriesCheckInterval in seconds.
+*/
+static QString queryOf(const QString &dirPath, const QString &filename)
+{
+    static int interval = Tf::app()->appSettings().value(CHECK_INTERVAL_KEY, 1).toInt();
+    uint now = QDateTime::currentDateTime().toTime_t();
+    QueryFile entry;
+    bool found;
+    {
+        QReadLocker locker(&cacheLock);
+        QHash<QString, QueryFile>::const_iterator it = queryCache.constFind(filename);
+        found = (it != queryCache.constEnd());
+        if (found) {
+            if (interval < 0 || now - it->checkedAt < (uint)interval) {
+                return it->query;
+            }
+            entry = *it;
+        }
+    }
+
+    QFileInfo fi(QDir(dirPath).filePath(filename));
+    QDateTime modified = fi.lastModified();
+    if (found && modified == entry.modified) {
+        QWriteLocker locker(&cacheLock);
+        queryCache[filename].checkedAt = now;
+        return entry.query;
+    }
+
+    QFile file(fi.filePath());
+    tSystemDebug("SQL_QUERY_ROOT: %s", qPrintable(dirPath));
+    tSystemDebug("filename: %s", qPrintable(file.fileName()));
+    if (!file.open(QIODevice::ReadOnly)) {
+        tSystemError("Unable to open file: %s", qPrintable(file.fileName()));
+        return QString();
+    }
+    if (found) {
+        tSystemDebug("SQL query file modified: %s", qPrintable(file.fileName()));
+    }
+
+    entry.query = QObject::tr(file.readAll().constData());
+    entry.modified = modified;
+    entry.checkedAt = now;
+
+    QWriteLocker locker(&cacheLock);
+    queryCache.insert(filename, entry);
+    return entry.query;
+}
+
+
+/*
+  Returns the database for the SQL \a query; a replica of the database
+  \a databaseId is returned for reading if available.
+*/
+static QSqlDatabase &databaseFor(const QString &query, int databaseId)
+{
+    TActionContext *ctx = TActionContext::current();
+    if (!query.isEmpty() && TSqlQuery::isWriteStatement(query)) {
+        QSqlDatabase &db = ctx->getDatabase(databaseId);
+        ctx->beginTransaction(db);
+        return db;
+    }
+    return ctx->getReadDatabase(databaseId);
+}
+
 
 /*!
   \class TSqlQuery
@@ -27,46 +113,65 @@ static QMutex cacheMutex;
   \a databaseId.
  */
 TSqlQuery::TSqlQuery(const QString &query, int databaseId)
-    : QSqlQuery(query, TActionContext::current()->getDatabase(databaseId))
+    : QSqlQuery(query, databaseFor(query, databaseId)), databaseId(databaseId),
+      writable(!query.isEmpty() && isWriteStatement(query))
 { }
 
 /*!
   Constructs a TSqlQuery object using the database \a databaseId.
 */
 TSqlQuery::TSqlQuery(int databaseId)
-    : QSqlQuery(QString(), TActionContext::current()->getDatabase(databaseId))
+    : QSqlQuery(QString(), TActionContext::current()->getReadDatabase(databaseId)), databaseId(databaseId),
+      writable(false)
 { }
 
 /*!
-  Loads a query from the given file \a filename.
+  Loads a query from the given file \a filename and prepares it. The
+  query is kept in memory and read again only if the file is modified.
+  The statement is prepared once per database connection and reused by
+  TSqlStatementCache while the connection is pooled; the prepared
+  statement is checked out of the cache until finish() is called or this
+  object is destroyed, so that another query does not share it.
 */
 bool TSqlQuery::load(const QString &filename)
 {
-    QMutexLocker locker(&cacheMutex);
-
-    QString query = queryCache.value(filename);
-    if (!query.isEmpty()) {
-        return QSqlQuery::prepare(query);
-    }
-
-    QDir dir(queryDirPath());
-    QFile file(dir.filePath(filename));
-    tSystemDebug("SQL_QUERY_ROOT: %s", qPrintable(dir.dirName()));
-    tSystemDebug("filename: %s", qPrintable(file.fileName()));
-    if (!file.open(QIODevice::ReadOnly)) {
-        tSystemError("Unable to open file: %s", qPrintable(file.fileName()));
+    QString query = queryOf(queryDirPath(), filename);
+    if (query.isEmpty()) {
         return false;
     }
 
-    query = QObject::tr(file.readAll().constData());
-    bool res = QSqlQuery::prepare(query);
-    if (res) {
-        // Caches the query-string
-        queryCache.insert(filename, query);
-    }
+    checkIn();
+    switchDatabase(query);
+    TActionContext *ctx = TActionContext::current();
+    QSqlDatabase &db = (writable) ? ctx->getDatabase(databaseId) : ctx->getReadDatabase(databaseId);
+    bool res;
+    QSqlQuery::operator=(TSqlStatementCache::checkOut(db, query, &res));
+    checkedOutConnection = db.connectionName();
     return res;
 }
 
+/*!
+  Instructs the database driver that no more data will be fetched from
+  this query until it is re-executed, and returns the statement loaded
+  by load() to the statement cache.
+*/
+void TSqlQuery::finish()
+{
+    QSqlQuery::finish();
+    checkIn();
+}
+
+/*
+  Returns the statement checked out by load() to the statement cache.
+*/
+void TSqlQuery::checkIn()
+{
+    if (!checkedOutConnection.isEmpty()) {
+        TSqlStatementCache::checkIn(checkedOutConnection, *this);
+        checkedOutConnection.clear();
+    }
+}
+
 /*!
   Returns the directory path for SQL query files, which is indicated by
   the value for application setting \a SqlQueriesStoredDirectory.
@@ -84,7 +189,7 @@ QString TSqlQuery::queryDirPath() const
 */
 void TSqlQuery::clearCachedQueries()
 {
-    QMutexLocker locker(&cacheMutex);
+    QWriteLocker locker(&cacheLock);
     queryCache.clear();
 }
 
@@ -95,7 +200,7 @@ void TSqlQuery::clearCachedQueries()
 */
 QString TSqlQuery::escapeIdentifier(const QString &identifier, QSqlDriver::IdentifierType type, int databaseId)
 {
-    return escapeIdentifier(identifier, type, TActionContext::current()->getDatabase(databaseId));
+    return escapeIdentifier(identifier, type, TActionContext::current()->getReadDatabase(databaseId));
 }
 
 /*!
@@ -119,7 +224,7 @@ QString TSqlQuery::escapeIdentifier(const QString &identifier, QSqlDriver::Ident
 */
 QString TSqlQuery::formatValue(const QVariant &val, int databaseId)
 {
-    return formatValue(val, TActionContext::current()->getDatabase(databaseId));
+    return formatValue(val, TActionContext::current()->getReadDatabase(databaseId));
 }
 
 /*!
@@ -139,10 +244,10 @@ QString TSqlQuery::formatValue(const QVariant &val, const QSqlDatabase &database
 */
 bool TSqlQuery::exec(const QString &query)
 {
-    bool ret = QSqlQuery::exec(query);
-    QString q = (ret) ? query : QLatin1String("(Query failed) ") + query;
-    tQueryLog("%s", qPrintable(q));
-    return ret;
+    checkIn();
+    switchDatabase(query);
+    beginTransactionForWrite(query);
+    return TSqlQueryStatistics::exec(*this, query);
 }
 
 /*!
@@ -151,9 +256,76 @@ bool TSqlQuery::exec(const QString &query)
 */
 bool TSqlQuery::exec()
 {
-    bool ret = QSqlQuery::exec();
-    QString q = executedQuery();
-    QString str = (ret) ? q : (QLatin1String("(Query failed) ") + (q.isEmpty() ? lastQuery() : q));
-    tQueryLog("%s", qPrintable(str));
-    return ret;   
+    beginTransactionForWrite(lastQuery());
+    return TSqlQueryStatistics::exec(*this);
+}
+
+/*!
+  Returns true if the SQL \a query may modify the database, i.e. it is
+  not a plain SELECT, SHOW or EXPLAIN statement; otherwise returns false.
+  Leading comments and parentheses are skipped. A statement whose
+  keyword is not recognized is regarded as a write statement.
+*/
+bool TSqlQuery::isWriteStatement(const QString &query)
+{
+    int pos = 0;
+    while (pos < query.length()) {
+        if (query[pos].isSpace() || query[pos] == QLatin1Char('(')) {
+            ++pos;
+        } else if (query.midRef(pos, 2) == QLatin1String("--")) {
+            int eol = query.indexOf(QLatin1Char('\n'), pos);
+            pos = (eol < 0) ? query.length() : eol + 1;
+        } else if (query.midRef(pos, 2) == QLatin1String("/*")) {
+            int end = query.indexOf(QLatin1String("*/"), pos + 2);
+            pos = (end < 0) ? query.length() : end + 2;
+        } else {
+            break;
+        }
+    }
+
+    QString stmt = query.mid(pos);
+    int len = 0;
+    while (len < stmt.length() && stmt[len].isLetter()) {
+        ++len;
+    }
+
+    QString keyword = stmt.left(len).toUpper();
+    if (keyword.isEmpty()) {
+        return true;
+    }
+
+    if (keyword == QLatin1String("SELECT")) {
+        // Locking reads need a transaction
+        return stmt.contains(QLatin1String(" FOR UPDATE"), Qt::CaseInsensitive)
+            || stmt.contains(QLatin1String(" FOR SHARE"), Qt::CaseInsensitive);
+    }
+    return !(keyword == QLatin1String("SHOW") || keyword == QLatin1String("EXPLAIN")
+             || keyword == QLatin1String("DESCRIBE") || keyword == QLatin1String("VALUES"));
+}
+
+/*!
+  Begins a transaction on the database of this query before the
+  write statement \a query is executed.
+*/
+void TSqlQuery::beginTransactionForWrite(const QString &query)
+{
+    if (isWriteStatement(query)) {
+        TActionContext::current()->beginTransaction(TActionContext::current()->getDatabase(databaseId));
+    }
+}
+
+/*!
+  Moves this query to the primary database before the write statement
+  \a query is prepared, if it was created on a replica for reading.
+*/
+void TSqlQuery::switchDatabase(const QString &query)
+{
+    if (writable || !isWriteStatement(query)) {
+        return;
+    }
+
+    writable = true;
+    if (TSqlDatabasePool::instance()->replicaCount(databaseId) > 0) {
+        QSqlQuery::operator=(QSqlQuery(TActionContext::current()->getDatabase(databaseId)));
+    }
 }
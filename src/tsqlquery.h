@@ -10,7 +10,9 @@ class T_CORE_EXPORT TSqlQuery : public QSqlQuery
 public:
     TSqlQuery(const QString &query = QString(), int databaseId = 0);
     TSqlQuery(int databaseId);
+    ~TSqlQuery() { finish(); }
 
+    void finish();
     TSqlQuery &prepare(const QString &query);
     bool load(const QString &filename);
     TSqlQuery &bind(const QString &placeholder, const QVariant &val);
@@ -26,6 +28,16 @@ public:
     static QString escapeIdentifier(const QString &identifier, QSqlDriver::IdentifierType type, const QSqlDatabase &database);
     static QString formatValue(const QVariant &val, int databaseId = 0);
     static QString formatValue(const QVariant &val, const QSqlDatabase &database);
+    static bool isWriteStatement(const QString &query);
+
+private:
+    void switchDatabase(const QString &query);
+    void beginTransactionForWrite(const QString &query);
+    void checkIn();
+
+    int databaseId;
+    bool writable;
+    QString checkedOutConnection;
 };
 
 
@@ -34,6 +46,8 @@ public:
 */
 inline TSqlQuery &TSqlQuery::prepare(const QString &query)
 {
+    checkIn();
+    switchDatabase(query);
     QSqlQuery::prepare(query);
     return *this;
 }
@@ -35,6 +35,20 @@
 */
 
 
+/*!
+  \fn TSqlQueryORMapper<T> &TSqlQueryORMapper<T>::setResultCache(bool enable, int lifeTime, const QStringList &joinedTables)
+  Enables the result cache for the subsequent findFirst() calls if
+  \a enable is true; otherwise disables it. The result is cached by the
+  SQL query and the bound values, and kept for \a lifeTime seconds, or
+  for TSqlResultCache::defaultLifeTime() seconds if \a lifeTime is 0,
+  unless the table of the class \a T or one of the tables
+  \a joinedTables is written before. If the query reads other tables
+  than the table of the class \a T, e.g. by joins or subqueries, all of
+  them must be listed in \a joinedTables.
+  \sa TSqlResultCache
+*/
+
+
 /*!
   \fn int TSqlQueryORMapper<T>::find()
   Executes the prepared SQL query and returns the number of the ORM objects.
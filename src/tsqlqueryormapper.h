@@ -5,6 +5,8 @@
 #include <QList>
 #include <TSqlQuery>
 #include <TCriteriaConverter>
+#include <TSqlResultCache>
+#include <TActionContext>
 #include <TSystemGlobal>
 
 
@@ -20,22 +22,28 @@ public:
     TSqlQueryORMapper<T> &bind(const QString &placeholder, const QVariant &val);
     TSqlQueryORMapper<T> &bind(int pos, const QVariant &val);
     TSqlQueryORMapper<T> &addBind(const QVariant &val);
+    TSqlQueryORMapper<T> &setResultCache(bool enable, int lifeTime = 0, const QStringList &joinedTables = QStringList());
     int find();
     T findFirst();
     T value() const;
     QString fieldName(int index) const;
+
+private:
+    bool cacheEnabled;
+    int cacheLifeTime;
+    QStringList cacheTables;
 };
 
 
 template <class T>
 inline TSqlQueryORMapper<T>::TSqlQueryORMapper(const QString &query, int databaseId)
-    : TSqlQuery(query, databaseId)
+    : TSqlQuery(query, databaseId), cacheEnabled(false), cacheLifeTime(0)
 { }
 
 
 template <class T>
 inline TSqlQueryORMapper<T>::TSqlQueryORMapper(int databaseId)
-    : TSqlQuery(databaseId)
+    : TSqlQuery(databaseId), cacheEnabled(false), cacheLifeTime(0)
 { }
 
 
@@ -78,11 +86,42 @@ inline TSqlQueryORMapper<T> &TSqlQueryORMapper<T>::addBind(const QVariant &val)
 }
 
 
+template <class T>
+inline TSqlQueryORMapper<T> &TSqlQueryORMapper<T>::setResultCache(bool enable, int lifeTime, const QStringList &joinedTables)
+{
+    cacheEnabled = enable;
+    cacheLifeTime = lifeTime;
+    cacheTables = QStringList(T().tableName()) + joinedTables;
+    return *this;
+}
+
+
 template <class T>
 inline T TSqlQueryORMapper<T>::findFirst()
 {
-    exec();
-    return (next()) ? value() : T();
+    T obj;
+    if (!cacheEnabled || TActionContext::current()->isDatabaseWritten(obj.databaseId())) {
+        exec();
+        return (next()) ? value() : T();
+    }
+
+    QList<QSqlRecord> records;
+    QByteArray cacheKey = TSqlResultCache::key(obj.databaseId(), cacheTables, lastQuery(), boundValues().values());
+    if (TSqlResultCache::lookup(cacheKey, records)) {
+        if (!records.isEmpty()) {
+            obj.setRecord(records.first(), QSqlError());
+        }
+        return obj;
+    }
+
+    if (exec()) {
+        if (next()) {
+            obj = value();
+            records << record();
+        }
+        TSqlResultCache::insert(cacheKey, records, cacheLifeTime);
+    }
+    return obj;
 }
 
 
@@ -0,0 +1,427 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QElapsedTimer>
+#include <QRegExp>
+#include <QSqlDriver>
+#include <QSqlRecord>
+#include <QSqlResult>
+#include <TSqlQueryStatistics>
+#include <TSqlQuery>
+#include <TWebApplication>
+#include "tsystemglobal.h"
+
+#define SLOW_QUERY_THRESHOLD_KEY  "SqlSlowQueryLog.Threshold"
+#define SLOW_QUERY_EXPLAIN_KEY    "SqlSlowQueryLog.Explain"
+#define MAX_SHAPES  1000
+#define MAX_QUERIES  10000
+
+/*!
+  \class TSqlQueryStatistics
+  \brief The TSqlQueryStatistics class times the SQL statements and keeps
+  the latency histograms per statement shape.
+
+  The shape of a statement is the statement whose literal values and
+  lists of placeholders are replaced with a '?', so that the statements
+  differing only in the values share a histogram. The histogram has
+  BucketCount buckets; the bucket \a i counts the statements which took
+  less than bucketUpperBound(\a i) microseconds, and the last one counts
+  the others.
+
+  Every statement is written to the SQL query log with the time and the
+  number of rows. The statements which took longer than the milliseconds
+  of the setting \a SqlSlowQueryLog.Threshold are also written to the
+  SQL slow query log, with the query plan of the database if the setting
+  \a SqlSlowQueryLog.Explain is true.
+*/
+
+
+class StatementShape
+{
+public:
+    StatementShape() : count(0), totalTime(0), maxTime(0)
+    {
+        for (int i = 0; i < TSqlQueryStatistics::BucketCount; ++i)
+            buckets[i] = 0;
+    }
+
+    quint64 count;
+    qint64 totalTime;  // usecs
+    qint64 maxTime;    // usecs
+    quint64 buckets[TSqlQueryStatistics::BucketCount];
+    QMutex mutex;
+};
+
+
+static QHash<QString, StatementShape *> shapes;
+static QHash<QString, StatementShape *> queries;  // key: statement
+static QReadWriteLock shapesLock;
+
+
+static StatementShape *statementShape(const QString &shape)
+{
+    {
+        QReadLocker locker(&shapesLock);
+        StatementShape *s = shapes.value(shape);
+        if (s)
+            return s;
+    }
+
+    QWriteLocker locker(&shapesLock);
+    StatementShape *s = shapes.value(shape);
+    if (!s) {
+        if (shapes.count() >= MAX_SHAPES) {
+            // Counts the rest together
+            static const QString others("(others)");
+            s = shapes.value(others);
+            if (!s) {
+                s = new StatementShape;
+                shapes.insert(others, s);
+            }
+        } else {
+            s = new StatementShape;
+            shapes.insert(shape, s);
+        }
+    }
+    return s;
+}
+
+/*
+  Returns the shape of the statement \a statement. The shapes are cached
+  by the statements, so that the prepared statements executed again are
+  not parsed again.
+*/
+static StatementShape *statementShapeOf(const QString &statement)
+{
+    {
+        QReadLocker locker(&shapesLock);
+        StatementShape *s = queries.value(statement);
+        if (s)
+            return s;
+    }
+
+    StatementShape *s = statementShape(TSqlQueryStatistics::shapeOf(statement));
+    QWriteLocker locker(&shapesLock);
+    if (queries.count() < MAX_QUERIES) {
+        queries.insert(statement, s);
+    }
+    return s;
+}
+
+
+static QString queryStatus(const QSqlQuery &query, qint64 usecs, bool ok)
+{
+    int rows = -1;
+    if (ok) {
+        rows = (query.isSelect()) ? query.size() : query.numRowsAffected();
+    }
+
+    QString stat = QString("(%1 ms").arg(usecs / 1000.0, 0, 'f', 3);
+    if (rows >= 0) {
+        stat += QString(", %1 rows").arg(rows);
+    }
+    stat += QLatin1String(") ");
+    return stat;
+}
+
+/*!
+  Executes the prepared query \a query and records the time. Returns true
+  if the query executed successfully; otherwise returns false.
+*/
+bool TSqlQueryStatistics::exec(QSqlQuery &query)
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool ret = query.exec();
+    record(query, timer.nsecsElapsed() / 1000, ret);
+    return ret;
+}
+
+/*!
+  Executes the SQL statement \a statement on the query \a query and
+  records the time. Returns true if the query executed successfully;
+  otherwise returns false.
+*/
+bool TSqlQueryStatistics::exec(QSqlQuery &query, const QString &statement)
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool ret = query.exec(statement);
+    record(query, timer.nsecsElapsed() / 1000, ret);
+    return ret;
+}
+
+/*!
+  Executes the prepared query \a query in a batch and records the time.
+  Returns true if the query executed successfully; otherwise returns
+  false.
+*/
+bool TSqlQueryStatistics::execBatch(QSqlQuery &query)
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool ret = query.execBatch();
+    record(query, timer.nsecsElapsed() / 1000, ret);
+    return ret;
+}
+
+/*!
+  Records that the query \a query took \a usecs microseconds, and writes
+  it to the SQL query log and, if slow, to the SQL slow query log. \a ok
+  is whether the query executed successfully.
+*/
+void TSqlQueryStatistics::record(const QSqlQuery &query, qint64 usecs, bool ok)
+{
+    QString sql = query.lastQuery();
+    if (tQueryLogEnabled()) {
+        tQueryLog("%s%s%s", qPrintable(queryStatus(query, usecs, ok)), (ok) ? "" : "(Query failed) ", qPrintable(sql));
+    }
+
+    if (!ok) {
+        return;
+    }
+
+    StatementShape *s = statementShapeOf(sql);
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && usecs >= bucketUpperBound(bucket)) {
+        ++bucket;
+    }
+
+    {
+        QMutexLocker locker(&s->mutex);
+        ++s->count;
+        s->totalTime += usecs;
+        s->maxTime = qMax(s->maxTime, usecs);
+        ++s->buckets[bucket];
+    }
+
+    int threshold = slowQueryThreshold();
+    if (threshold > 0 && usecs >= threshold * 1000LL && tSlowQueryLogEnabled()) {
+        static bool explainEnabled = Tf::app()->appSettings().value(SLOW_QUERY_EXPLAIN_KEY, false).toBool();
+        QString plan;
+        if (explainEnabled && !TSqlQuery::isWriteStatement(sql)) {
+            plan = explain(query);
+        }
+        tSlowQueryLog("%s%s%s%s", qPrintable(queryStatus(query, usecs, ok)), qPrintable(sql),
+                      (plan.isEmpty()) ? "" : "  [Plan] ", qPrintable(plan));
+    }
+}
+
+/*!
+  Returns the query plan of the query \a query, which is retrieved from
+  the database by the EXPLAIN statement with the same bound values.
+*/
+QString TSqlQueryStatistics::explain(const QSqlQuery &query)
+{
+    const QSqlDriver *driver = query.driver();
+    if (!driver) {
+        return QString();
+    }
+
+    QString prefix = QLatin1String("EXPLAIN ");
+    if (QLatin1String(driver->metaObject()->className()).contains("SQLite", Qt::CaseInsensitive)) {
+        prefix = QLatin1String("EXPLAIN QUERY PLAN ");
+    }
+
+    QSqlQuery ex(driver->createResult());
+    if (!ex.prepare(prefix + query.lastQuery())) {
+        return QString();
+    }
+    for (int i = 0; i < query.boundValues().count(); ++i) {
+        ex.bindValue(i, query.boundValue(i));
+    }
+    if (!ex.exec()) {
+        return QString();
+    }
+
+    QStringList rows;
+    while (ex.next()) {
+        QSqlRecord rec = ex.record();
+        QStringList cols;
+        for (int i = 0; i < rec.count(); ++i) {
+            cols << rec.value(i).toString();
+        }
+        rows << cols.join(" ");
+    }
+    return rows.join("; ");
+}
+
+/*!
+  Returns the shapes of the statements recorded.
+*/
+QStringList TSqlQueryStatistics::statementShapes()
+{
+    QReadLocker locker(&shapesLock);
+    return shapes.keys();
+}
+
+/*!
+  Returns the number of the statements of the shape \a shape.
+*/
+quint64 TSqlQueryStatistics::count(const QString &shape)
+{
+    QReadLocker locker(&shapesLock);
+    StatementShape *s = shapes.value(shape);
+    if (!s)
+        return 0;
+
+    QMutexLocker lock(&s->mutex);
+    return s->count;
+}
+
+/*!
+  Returns the total microseconds taken by the statements of the shape
+  \a shape.
+*/
+qint64 TSqlQueryStatistics::totalTime(const QString &shape)
+{
+    QReadLocker locker(&shapesLock);
+    StatementShape *s = shapes.value(shape);
+    if (!s)
+        return 0;
+
+    QMutexLocker lock(&s->mutex);
+    return s->totalTime;
+}
+
+/*!
+  Returns the longest microseconds taken by a statement of the shape
+  \a shape.
+*/
+qint64 TSqlQueryStatistics::maxTime(const QString &shape)
+{
+    QReadLocker locker(&shapesLock);
+    StatementShape *s = shapes.value(shape);
+    if (!s)
+        return 0;
+
+    QMutexLocker lock(&s->mutex);
+    return s->maxTime;
+}
+
+/*!
+  Returns the latency histogram of the statements of the shape \a shape,
+  which has BucketCount buckets.
+  \sa bucketUpperBound()
+*/
+QVector<quint64> TSqlQueryStatistics::histogram(const QString &shape)
+{
+    QVector<quint64> hist(BucketCount, 0);
+    QReadLocker locker(&shapesLock);
+    StatementShape *s = shapes.value(shape);
+    if (s) {
+        QMutexLocker lock(&s->mutex);
+        for (int i = 0; i < BucketCount; ++i) {
+            hist[i] = s->buckets[i];
+        }
+    }
+    return hist;
+}
+
+/*!
+  Returns the upper bound in microseconds of the bucket \a bucket of the
+  histograms, which doubles from 64 microseconds. The last bucket has no
+  upper bound, and -1 is returned.
+*/
+qint64 TSqlQueryStatistics::bucketUpperBound(int bucket)
+{
+    if (bucket < 0 || bucket >= BucketCount - 1) {
+        return -1;
+    }
+    return 64LL << bucket;
+}
+
+/*!
+  Discards all the statistics.
+*/
+void TSqlQueryStatistics::clear()
+{
+    QWriteLocker locker(&shapesLock);
+    queries.clear();
+    qDeleteAll(shapes);
+    shapes.clear();
+}
+
+/*!
+  Returns the shape of the SQL statement \a statement, in which the
+  string and numeric literals are replaced with a '?', a list of
+  placeholders such as 'IN (?, ?, ?)' is folded into '(?)' and the
+  whitespaces are collapsed.
+*/
+QString TSqlQueryStatistics::shapeOf(const QString &statement)
+{
+    QString shape;
+    shape.reserve(statement.length());
+    bool space = false;
+
+    for (int i = 0; i < statement.length(); ++i) {
+        QChar c = statement[i];
+        if (c.isSpace()) {
+            space = true;
+            continue;
+        }
+        if (space && !shape.isEmpty()) {
+            shape += QLatin1Char(' ');
+        }
+        space = false;
+
+        if (c == QLatin1Char('\'')) {
+            // String literal
+            for (++i; i < statement.length(); ++i) {
+                if (statement[i] == QLatin1Char('\'')) {
+                    if (i + 1 < statement.length() && statement[i + 1] == QLatin1Char('\'')) {
+                        ++i;  // escaped quote
+                    } else {
+                        break;
+                    }
+                }
+            }
+            shape += QLatin1Char('?');
+        } else if (c == QLatin1Char('"') || c == QLatin1Char('`')) {
+            // Quoted identifier
+            int end = statement.indexOf(c, i + 1);
+            if (end < 0)
+                end = statement.length() - 1;
+            shape += statement.mid(i, end - i + 1);
+            i = end;
+        } else if (c.isDigit() && (shape.isEmpty() || !(shape.at(shape.length() - 1).isLetterOrNumber() || shape.at(shape.length() - 1) == QLatin1Char('_')))) {
+            // Numeric literal
+            while (i + 1 < statement.length() && (statement[i + 1].isDigit() || statement[i + 1] == QLatin1Char('.'))) {
+                ++i;
+            }
+            shape += QLatin1Char('?');
+        } else {
+            shape += c;
+        }
+    }
+
+    // Folds the lists of placeholders
+    static const QRegExp list("\\(\\s*\\?(\\s*,\\s*\\?)*\\s*\\)");
+    static const QRegExp rows("\\(\\?\\)(\\s*,\\s*\\(\\?\\))+");
+    QRegExp listRx = list;
+    QRegExp rowsRx = rows;
+    shape.replace(listRx, QLatin1String("(?)"));
+    shape.replace(rowsRx, QLatin1String("(?)"));
+    return shape;
+}
+
+/*!
+  Returns the threshold in milliseconds of the slow queries, which is
+  indicated by the value for application setting
+  \a SqlSlowQueryLog.Threshold. 0 disables the slow query log.
+*/
+int TSqlQueryStatistics::slowQueryThreshold()
+{
+    static int threshold = Tf::app()->appSettings().value(SLOW_QUERY_THRESHOLD_KEY, 1000).toInt();
+    return threshold;
+}
@@ -0,0 +1,36 @@
+#ifndef TSQLQUERYSTATISTICS_H
+#define TSQLQUERYSTATISTICS_H
+
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TSqlQueryStatistics
+{
+public:
+    enum { BucketCount = 20 };
+
+    static bool exec(QSqlQuery &query);
+    static bool exec(QSqlQuery &query, const QString &statement);
+    static bool execBatch(QSqlQuery &query);
+    static void record(const QSqlQuery &query, qint64 usecs, bool ok);
+
+    static QStringList statementShapes();
+    static quint64 count(const QString &shape);
+    static qint64 totalTime(const QString &shape);
+    static qint64 maxTime(const QString &shape);
+    static QVector<quint64> histogram(const QString &shape);
+    static qint64 bucketUpperBound(int bucket);
+    static void clear();
+    static QString shapeOf(const QString &statement);
+    static int slowQueryThreshold();
+
+private:
+    static QString explain(const QSqlQuery &query);
+    TSqlQueryStatistics();
+};
+
+#endif // TSQLQUERYSTATISTICS_H
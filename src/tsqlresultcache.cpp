@@ -0,0 +1,219 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QHash>
+#include <QBuffer>
+#include <QDataStream>
+#include <QSqlField>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <TSqlResultCache>
+#include <TCache>
+#include <TWebApplication>
+
+#define MAX_ENTRIES_KEY  "SqlResultCache.MaxEntries"
+#define LIFE_TIME_KEY    "SqlResultCache.LifeTime"
+
+Q_GLOBAL_STATIC_WITH_ARGS(TCache, resultCache, (Tf::app()->appSettings().value(MAX_ENTRIES_KEY, 1000).toInt()))
+
+/*!
+  \class TSqlResultCache
+  \brief The TSqlResultCache class caches the rows retrieved by SELECT
+  statements, keyed by the table, the statement and the bound values.
+
+  The cache is opt-in; the mappers use it only if enabled by
+  TSqlORMapper::setResultCache() or TSqlQueryORMapper::setResultCache().
+  Each table has a generation number, which is a part of the keys of the
+  results read from it, and invalidate() increments the generation when a row of the
+  table is written, so that the stale results are never looked up again
+  and are discarded as the least recently used ones. The writes by
+  TSqlObject and TSqlORMapper invalidate the table automatically, once
+  before the write and once more after the commit; the mappers neither
+  look up nor insert results of a database the current action has
+  written to, since its rows may be uncommitted.
+  The key is taken by key() before the statement is executed, so that
+  the results are inserted under the generations they were read in; the
+  results read across an invalidation are never looked up.
+  The cache is held in each server process.
+*/
+
+static QHash<QString, quint32> generations;  // key: table name
+static QReadWriteLock generationsLock;
+
+
+/*
+  Collapses the whitespaces outside the quoted literals and identifiers
+  of the SQL statement \a statement, so that the statements differing
+  only in the layout share the results.
+*/
+static QString normalize(const QString &statement)
+{
+    QString sql;
+    sql.reserve(statement.length());
+    QChar quote;
+    bool space = false;
+    for (int i = 0; i < statement.length(); ++i) {
+        const QChar &c = statement[i];
+        if (quote.isNull()) {
+            if (c.isSpace()) {
+                space = true;
+                continue;
+            }
+            if (space && !sql.isEmpty()) {
+                sql += QLatin1Char(' ');
+            }
+            space = false;
+            if (c == QLatin1Char('\'') || c == QLatin1Char('"') || c == QLatin1Char('`')) {
+                quote = c;
+            }
+        } else if (c == quote) {
+            quote = QChar();
+        }
+        sql += c;
+    }
+    return sql;
+}
+
+
+static QByteArray serialize(const QList<QSqlRecord> &records)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream ds(&buffer);
+
+    ds << (qint32)records.count();
+    for (QListIterator<QSqlRecord> it(records); it.hasNext(); ) {
+        const QSqlRecord &rec = it.next();
+        ds << (qint32)rec.count();
+        for (int i = 0; i < rec.count(); ++i) {
+            ds << rec.fieldName(i) << rec.value(i);
+        }
+    }
+    return data;
+}
+
+
+static QList<QSqlRecord> deserialize(const QByteArray &data)
+{
+    QList<QSqlRecord> records;
+    QDataStream ds(data);
+    qint32 rows;
+    ds >> rows;
+    for (int r = 0; r < rows && ds.status() == QDataStream::Ok; ++r) {
+        QSqlRecord rec;
+        qint32 cols;
+        ds >> cols;
+        for (int i = 0; i < cols; ++i) {
+            QString name;
+            QVariant val;
+            ds >> name >> val;
+            QSqlField field(name, val.type());
+            field.setValue(val);
+            rec.append(field);
+        }
+        records << rec;
+    }
+    return records;
+}
+
+/*!
+  Returns the key of the results of the SQL statement \a statement with
+  the bound values \a values on the database \a databaseId, which reads
+  the tables \a tables. The key contains the current generations of the
+  tables, so it must be taken before the statement is executed.
+*/
+QByteArray TSqlResultCache::key(int databaseId, const QStringList &tables, const QString &statement, const QVariantList &values)
+{
+    QByteArray key;
+    QBuffer buffer(&key);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream ds(&buffer);
+    ds << (qint32)databaseId;
+    {
+        QReadLocker locker(&generationsLock);
+        for (QStringListIterator it(tables); it.hasNext(); ) {
+            const QString &table = it.next();
+            ds << table << generations.value(table);
+        }
+    }
+    ds << normalize(statement) << values;
+    return key;
+}
+
+/*!
+  Looks up the results by the key \a key taken by key().
+  Returns true and sets the rows
+  to \a records if found; otherwise returns false.
+*/
+bool TSqlResultCache::lookup(const QByteArray &key, QList<QSqlRecord> &records)
+{
+    QByteArray data = resultCache()->value(key);
+    if (data.isNull()) {
+        return false;
+    }
+    records = deserialize(data);
+    return true;
+}
+
+/*!
+  Inserts the rows \a records by the key \a key, which was taken by
+  key() before the rows were retrieved. The rows expire
+  after \a lifeTime seconds; if \a lifeTime is 0, after defaultLifeTime()
+  seconds.
+*/
+void TSqlResultCache::insert(const QByteArray &key, const QList<QSqlRecord> &records, int lifeTime)
+{
+    if (lifeTime <= 0) {
+        lifeTime = defaultLifeTime();
+    }
+    resultCache()->insert(key, serialize(records), lifeTime);
+}
+
+/*!
+  Invalidates all the results cached for the table \a table.
+*/
+void TSqlResultCache::invalidate(const QString &table)
+{
+    QWriteLocker locker(&generationsLock);
+    ++generations[table];
+}
+
+/*!
+  Discards all the cached results.
+*/
+void TSqlResultCache::clear()
+{
+    resultCache()->clear();
+}
+
+/*!
+  Returns the number of seconds to keep results, which is indicated by
+  the value for application setting \a SqlResultCache.LifeTime.
+*/
+int TSqlResultCache::defaultLifeTime()
+{
+    static int lifeTime = qMax(Tf::app()->appSettings().value(LIFE_TIME_KEY, 60).toInt(), 1);
+    return lifeTime;
+}
+
+/*!
+  Returns the number of times cached results were found.
+*/
+quint64 TSqlResultCache::hitCount()
+{
+    return resultCache()->hitCount();
+}
+
+/*!
+  Returns the number of times results were not found.
+*/
+quint64 TSqlResultCache::missCount()
+{
+    return resultCache()->missCount();
+}
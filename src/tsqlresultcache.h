@@ -0,0 +1,28 @@
+#ifndef TSQLRESULTCACHE_H
+#define TSQLRESULTCACHE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QList>
+#include <QSqlRecord>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TSqlResultCache
+{
+public:
+    static QByteArray key(int databaseId, const QStringList &tables, const QString &statement, const QVariantList &values);
+    static bool lookup(const QByteArray &key, QList<QSqlRecord> &records);
+    static void insert(const QByteArray &key, const QList<QSqlRecord> &records, int lifeTime = 0);
+    static void invalidate(const QString &table);
+    static void clear();
+    static int defaultLifeTime();
+    static quint64 hitCount();
+    static quint64 missCount();
+
+private:
+    TSqlResultCache();
+};
+
+#endif // TSQLRESULTCACHE_H
@@ -0,0 +1,272 @@
+/* Copyright (c) 2010-2012, AOYAMA Kazuharu
+ * All rights reserved.
+ *
+ * This software may be used and distributed according to the terms of
+ * the New BSD License, which is incorporated herein by reference.
+ */
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QSqlDriver>
+#include <TSqlStatementCache>
+#include <TSqlQueryStatistics>
+#include <TWebApplication>
+#include "tsystemglobal.h"
+
+#define MAX_ENTRIES_KEY  "SqlStatementCache.MaxEntries"
+
+/*!
+  \class TSqlStatementCache
+  \brief The TSqlStatementCache class keeps prepared statements for each
+  pooled database connection.
+
+  A statement is prepared once per connection and reused afterwards, so
+  that the database server does not parse and plan the same SQL again.
+  Each connection holds up to capacity() statements; when it is full,
+  the least recently used statement is discarded. The statements of a
+  connection must be cleared by clear() before the connection is closed.
+
+  A query returned by prepare() is shared with the cache until it is
+  finished. A query kept over other statements, such as the one loaded
+  by TSqlQuery::load(), is taken by checkOut() instead, and is not
+  returned again until checkIn().
+*/
+
+
+class StatementList
+{
+public:
+    struct Entry
+    {
+        QSqlQuery query;
+        quint64 lastUsed;
+        bool checkedOut;
+    };
+
+    StatementList() : tick(0), hits(0), misses(0) { }
+
+    QHash<QString, Entry> statements;
+    quint64 tick;
+    quint64 hits;
+    quint64 misses;
+    QMutex mutex;
+};
+
+
+static QHash<QString, StatementList *> statementLists;  // key: connection name
+static QReadWriteLock listsLock;
+static quint64 clearedHits = 0;
+static quint64 clearedMisses = 0;
+
+
+static StatementList *statementList(const QString &connectionName)
+{
+    {
+        QReadLocker locker(&listsLock);
+        StatementList *list = statementLists.value(connectionName);
+        if (list)
+            return list;
+    }
+
+    QWriteLocker locker(&listsLock);
+    StatementList *list = statementLists.value(connectionName);
+    if (!list) {
+        list = new StatementList;
+        statementLists.insert(connectionName, list);
+    }
+    return list;
+}
+
+/*!
+  Returns a query prepared with the SQL statement \a statement for the
+  database connection \a database. If the statement has been prepared on
+  the connection already and the query is neither active nor checked
+  out, the cached query is returned. If \a ok is not 0, *ok is set to
+  true if the statement was prepared successfully.
+
+  Call QSqlQuery::finish() once the results of the query are consumed,
+  so that the query can be reused.
+*/
+QSqlQuery TSqlStatementCache::prepare(const QSqlDatabase &database, const QString &statement, bool *ok)
+{
+    return prepareQuery(database, statement, ok, false);
+}
+
+/*!
+  Returns a query prepared with the SQL statement \a statement for the
+  database connection \a database, as prepare() does, and marks the
+  cached query as checked out; it is not returned by prepare() or
+  checkOut() until checkIn() is called for it. If the cached query is
+  checked out already, another one which is not cached is returned.
+*/
+QSqlQuery TSqlStatementCache::checkOut(const QSqlDatabase &database, const QString &statement, bool *ok)
+{
+    return prepareQuery(database, statement, ok, true);
+}
+
+/*!
+  Marks the query \a query of the database connection \a connectionName
+  as checked in, if it is the cached one checked out by checkOut().
+*/
+void TSqlStatementCache::checkIn(const QString &connectionName, const QSqlQuery &query)
+{
+    StatementList *list;
+    {
+        QReadLocker locker(&listsLock);
+        list = statementLists.value(connectionName);
+    }
+    if (!list) {
+        return;
+    }
+
+    QMutexLocker locker(&list->mutex);
+    QHash<QString, StatementList::Entry>::iterator it = list->statements.find(query.lastQuery());
+    if (it != list->statements.end() && it->query.result() == query.result()) {
+        it->checkedOut = false;
+    }
+}
+
+
+QSqlQuery TSqlStatementCache::prepareQuery(const QSqlDatabase &database, const QString &statement, bool *ok, bool checkOut)
+{
+    int max = capacity();
+    if (max <= 0 || !database.isValid() || !database.driver()->hasFeature(QSqlDriver::PreparedQueries)) {
+        QSqlQuery query(database);
+        bool res = query.prepare(statement);
+        if (ok)
+            *ok = res;
+        return query;
+    }
+
+    StatementList *list = statementList(database.connectionName());
+    QMutexLocker locker(&list->mutex);
+
+    QHash<QString, StatementList::Entry>::iterator it = list->statements.find(statement);
+    if (it != list->statements.end()) {
+        if (!it->checkedOut && !it->query.isActive()) {
+            it->checkedOut = checkOut;
+            it->lastUsed = ++list->tick;
+            ++list->hits;
+            if (ok)
+                *ok = true;
+            return it->query;
+        }
+        // In use now; prepares another one which is not cached
+    }
+    ++list->misses;
+
+    QSqlQuery query(database);
+    bool res = query.prepare(statement);
+    if (ok)
+        *ok = res;
+
+    if (!res) {
+        tSystemError("SQL prepare error: %s  [%s]", qPrintable(query.lastError().text()), qPrintable(statement));
+        return query;
+    }
+
+    if (it == list->statements.end()) {
+        if (list->statements.count() >= max) {
+            // Discards the least recently used statement
+            QHash<QString, StatementList::Entry>::iterator lru = list->statements.begin();
+            for (QHash<QString, StatementList::Entry>::iterator i = list->statements.begin(); i != list->statements.end(); ++i) {
+                if (i->lastUsed < lru->lastUsed)
+                    lru = i;
+            }
+            list->statements.erase(lru);
+        }
+
+        StatementList::Entry entry;
+        entry.query = query;
+        entry.lastUsed = ++list->tick;
+        entry.checkedOut = checkOut;
+        list->statements.insert(statement, entry);
+    }
+    return query;
+}
+
+/*!
+  Binds the values \a values to the placeholders of the prepared query
+  \a query in order and executes it. Returns true if the query executed
+  successfully; otherwise returns false. The time is recorded by
+  TSqlQueryStatistics.
+*/
+bool TSqlStatementCache::exec(QSqlQuery &query, const QVariantList &values)
+{
+    for (int i = 0; i < values.count(); ++i) {
+        query.bindValue(i, values[i]);
+    }
+    return TSqlQueryStatistics::exec(query);
+}
+
+/*!
+  Discards all the statements prepared for the database connection
+  \a connectionName.
+*/
+void TSqlStatementCache::clear(const QString &connectionName)
+{
+    QWriteLocker locker(&listsLock);
+    StatementList *list = statementLists.take(connectionName);
+    if (list) {
+        clearedHits += list->hits;
+        clearedMisses += list->misses;
+        delete list;
+    }
+}
+
+/*!
+  Discards all the statements prepared for all the connections.
+*/
+void TSqlStatementCache::clearAll()
+{
+    QWriteLocker locker(&listsLock);
+    for (QHash<QString, StatementList *>::iterator it = statementLists.begin(); it != statementLists.end(); ++it) {
+        clearedHits += it.value()->hits;
+        clearedMisses += it.value()->misses;
+        delete it.value();
+    }
+    statementLists.clear();
+}
+
+/*!
+  Returns the maximum number of statements cached per connection, which
+  is indicated by the value for application setting
+  \a SqlStatementCache.MaxEntries. 0 disables the cache.
+*/
+int TSqlStatementCache::capacity()
+{
+    static int maxEntries = Tf::app()->appSettings().value(MAX_ENTRIES_KEY, 64).toInt();
+    return maxEntries;
+}
+
+/*!
+  Returns the number of times a cached statement was reused.
+*/
+quint64 TSqlStatementCache::hitCount()
+{
+    QReadLocker locker(&listsLock);
+    quint64 cnt = clearedHits;
+    for (QHash<QString, StatementList *>::const_iterator it = statementLists.constBegin(); it != statementLists.constEnd(); ++it) {
+        QMutexLocker lock(&it.value()->mutex);
+        cnt += it.value()->hits;
+    }
+    return cnt;
+}
+
+/*!
+  Returns the number of times a statement was prepared.
+*/
+quint64 TSqlStatementCache::missCount()
+{
+    QReadLocker locker(&listsLock);
+    quint64 cnt = clearedMisses;
+    for (QHash<QString, StatementList *>::const_iterator it = statementLists.constBegin(); it != statementLists.constEnd(); ++it) {
+        QMutexLocker lock(&it.value()->mutex);
+        cnt += it.value()->misses;
+    }
+    return cnt;
+}
@@ -0,0 +1,29 @@
+#ifndef TSQLSTATEMENTCACHE_H
+#define TSQLSTATEMENTCACHE_H
+
+#include <QSqlQuery>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVariant>
+#include <TGlobal>
+
+
+class T_CORE_EXPORT TSqlStatementCache
+{
+public:
+    static QSqlQuery prepare(const QSqlDatabase &database, const QString &statement, bool *ok = 0);
+    static QSqlQuery checkOut(const QSqlDatabase &database, const QString &statement, bool *ok = 0);
+    static void checkIn(const QString &connectionName, const QSqlQuery &query);
+    static bool exec(QSqlQuery &query, const QVariantList &values);
+    static void clear(const QString &connectionName);
+    static void clearAll();
+    static int capacity();
+    static quint64 hitCount();
+    static quint64 missCount();
+
+private:
+    static QSqlQuery prepareQuery(const QSqlDatabase &database, const QString &statement, bool *ok, bool checkOut);
+    TSqlStatementCache();
+};
+
+#endif // TSQLSTATEMENTCACHE_H
@@ -5,18 +5,32 @@
  * the New BSD License, which is incorporated herein by reference.
  */
 
+#include <QSqlQuery>
 #include <TSqlTransaction>
+#include <TSqlDatabasePool>
 #include <TWebApplication>
 #include <TSystemGlobal>
 
 /*!
   \class TSqlTransaction
   \brief The TSqlTransaction class provides a transaction of database.
+
+  In read-only mode, a transaction is begun as a read-only transaction
+  on PostgreSQL and MySQL, so that the server can skip the bookkeeping
+  for writes. Other drivers run the statements in autocommit mode.
 */
 
 
+static int databaseIdOf(const QSqlDatabase &database)
+{
+    bool ok;
+    int id = database.connectionName().left(2).toInt(&ok);
+    return (ok) ? id : -1;
+}
+
+
 TSqlTransaction::TSqlTransaction()
-    : enabled(true), databases(Tf::app()->databaseSettingsCount())
+    : enabled(true), readOnly(false), databases(TSqlDatabasePool::instance()->databaseCount())
 { }
 
 
@@ -36,10 +50,8 @@ bool TSqlTransaction::begin(QSqlDatabase &database)
     if (!enabled)
         return true;
     
-    bool ok;
-    int id = database.connectionName().left(2).toInt(&ok);
-    
-    if (!ok || id < 0 || id >= databases.count()) {
+    int id = databaseIdOf(database);
+    if (id < 0 || id >= databases.count()) {
         tSystemError("Internal Error  [%s:%d]", __FILE__, __LINE__);
         return false;
     }
@@ -49,6 +61,10 @@ bool TSqlTransaction::begin(QSqlDatabase &database)
         return true;
     }
 
+    if (readOnly) {
+        return beginReadOnly(database, id);
+    }
+
     if (database.transaction()) {
         tQueryLog("[BEGIN] [databaseId:%d]", id);
     }
@@ -58,6 +74,43 @@ bool TSqlTransaction::begin(QSqlDatabase &database)
 }
 
 
+bool TSqlTransaction::beginReadOnly(QSqlDatabase &database, int id)
+{
+    QString driver = database.driverName().toUpper();
+    if (driver == QLatin1String("QPSQL")) {
+        // Must be the first statement of the transaction
+        if (database.transaction()) {
+            QSqlQuery query(database);
+            query.exec("SET TRANSACTION READ ONLY");
+            tQueryLog("[BEGIN READ ONLY] [databaseId:%d]", id);
+        }
+    } else if (driver == QLatin1String("QMYSQL")) {
+        // Applies to the next transaction only
+        QSqlQuery query(database);
+        query.exec("SET TRANSACTION READ ONLY");
+        if (database.transaction()) {
+            tQueryLog("[BEGIN READ ONLY] [databaseId:%d]", id);
+        }
+    } else {
+        tSystemDebug("Read-only transaction not supported, autocommit mode: %s", qPrintable(database.connectionName()));
+        return true;
+    }
+
+    databases[id] = database;
+    return true;
+}
+
+/*!
+  Returns true if a transaction has been begun on the database
+  connection \a database; otherwise returns false.
+*/
+bool TSqlTransaction::isActive(const QSqlDatabase &database) const
+{
+    int id = databaseIdOf(database);
+    return (id >= 0 && id < databases.count() && databases[id].isValid());
+}
+
+
 void TSqlTransaction::commit()
 {
     for (int i = 0; i < databases.count(); ++i) {
@@ -20,9 +20,15 @@ public:
     void rollback();
     void setEnabled(bool enable);
     void setDisabled(bool disable);
+    bool isActive(const QSqlDatabase &database) const;
+    bool isReadOnly() const { return readOnly; }
+    void setReadOnly(bool enable);
 
 private:
+    bool beginReadOnly(QSqlDatabase &database, int id);
+
     bool enabled;
+    bool readOnly;
     QVector<QSqlDatabase> databases;
 };
 
@@ -38,4 +44,10 @@ inline void TSqlTransaction::setDisabled(bool disable)
     enabled = !disable;
 }
 
+
+inline void TSqlTransaction::setReadOnly(bool enable)
+{
+    readOnly = enable;
+}
+
 #endif // TSQLTRANSACTION_H
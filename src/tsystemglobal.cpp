@@ -21,6 +21,7 @@
 
 static TAccessLogStream *accesslogstrm = 0;
 static TAccessLogStream *sqllogstrm = 0;
+static TAccessLogStream *slowlogstrm = 0;
 static QFile systemLog;
 static QByteArray syslogLayout;
 static QByteArray syslogDateTimeFormat;
@@ -59,6 +60,13 @@ void tSetupSystemLoggers()
             sqllogstrm = new TAccessLogStream(path);
     }
 
+    // sql slow query log
+    if (!slowlogstrm) {
+        QString path = Tf::app()->sqlSlowQueryLogFilePath();
+        if (!path.isEmpty())
+            slowlogstrm = new TAccessLogStream(path);
+    }
+
     syslogLayout = Tf::app()->appSettings().value("SystemLog.Layout", "%d %5P %m%n").toByteArray();
     syslogDateTimeFormat = Tf::app()->appSettings().value("SystemLog.DateTimeFormat", "yyyy-MM-ddThh:mm:ss").toByteArray();
     accessLogLayout = Tf::app()->appSettings().value("AccessLog.Layout", "%h %d \"%r\" %s %O%n").toByteArray();
@@ -66,6 +74,21 @@ void tSetupSystemLoggers()
 }
 
 
+/*!
+  Writes the pending logs of the access log and the SQL query logs, and
+  releases the streams. This function is for internal use only.
+*/
+void tReleaseSystemLoggers()
+{
+    delete accesslogstrm;
+    accesslogstrm = 0;
+    delete sqllogstrm;
+    sqllogstrm = 0;
+    delete slowlogstrm;
+    slowlogstrm = 0;
+}
+
+
 static void tSystemMessage(int priority, const char *msg, va_list ap)
 {
     static QSystemSemaphore semaphore("TreeFrogSystemLog", 1, QSystemSemaphore::Open);
@@ -146,3 +169,28 @@ void tQueryLog(const char *msg, ...)
         va_end(ap);
     }
 }
+
+
+bool tQueryLogEnabled()
+{
+    return sqllogstrm != 0;
+}
+
+
+bool tSlowQueryLogEnabled()
+{
+    return slowlogstrm != 0;
+}
+
+
+void tSlowQueryLog(const char *msg, ...)
+{
+    if (slowlogstrm) {
+        va_list ap;
+        va_start(ap, msg);
+        TLog log(-1, QString().vsprintf(msg, ap).toLocal8Bit());
+        QByteArray buf = TLogger::logToByteArray(log, syslogLayout, syslogDateTimeFormat);
+        slowlogstrm->writeLog(buf);
+        va_end(ap);
+    }
+}
@@ -11,6 +11,7 @@ class TAccessLog;
 T_CORE_EXPORT void writeAccessLog(const TAccessLog &log); // write access log
 
 T_CORE_EXPORT void tSetupSystemLoggers();  // internal use
+T_CORE_EXPORT void tReleaseSystemLoggers();  // internal use
 
 T_CORE_EXPORT void tSystemError(const char *, ...) // system error message
 #if defined(Q_CC_GNU) && !defined(__INSURE__)
@@ -48,6 +49,15 @@ T_CORE_EXPORT void tQueryLog(const char *, ...) // SQL query log
 #endif
 ;
 
+T_CORE_EXPORT void tSlowQueryLog(const char *, ...) // SQL slow query log
+#if defined(Q_CC_GNU) && !defined(__INSURE__)
+    __attribute__ ((format (printf, 1, 2)))
+#endif
+;
+
+T_CORE_EXPORT bool tQueryLogEnabled();  // internal use
+T_CORE_EXPORT bool tSlowQueryLogEnabled();  // internal use
+
 #if !defined(TF_NO_DEBUG) && ENABLE_TO_TRACE_FUNCTION && !defined(Q_OS_WIN)
 
 class T_CORE_EXPORT TTraceFunc
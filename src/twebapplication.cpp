@@ -337,6 +337,20 @@ QString TWebApplication::sqlQueryLogFilePath() const
     return path;
 }
 
+/*!
+  Returns the absolute file path of the SQL slow query log, which is set
+  by the setting \a SqlSlowQueryLogFile in the application.ini.
+*/
+QString TWebApplication::sqlSlowQueryLogFilePath() const
+{
+    QString path = appSettings().value("SqlSlowQueryLogFile").toString();
+    if (!path.isEmpty()) {
+        QFileInfo fi(path);
+        path = (fi.isAbsolute()) ? fi.absoluteFilePath() : webRootPath() + fi.filePath();
+    }
+    return path;
+}
+
 
 void TWebApplication::timerEvent(QTimerEvent *event)
 {
@@ -62,6 +62,7 @@ public:
     QString systemLogFilePath() const;
     QString accessLogFilePath() const;
     QString sqlQueryLogFilePath() const;
+    QString sqlSlowQueryLogFilePath() const;
     QTextCodec *codecForInternal() const { return codecInternal; }
     QTextCodec *codecForHttpOutput() const { return codecHttp; }
 
@@ -171,6 +171,7 @@ int main(int argc, char *argv[])
     ret = webapp.exec();
 
 finish:
+    tReleaseSystemLoggers();
     _exit(ret);
     return ret;
 }
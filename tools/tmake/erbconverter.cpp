@@ -23,13 +23,20 @@
     "public:\n"                                                 \
     "  %1() : TActionView() { }\n"                              \
     "  %1(const %1 &) : TActionView() { }\n"                    \
-    "  QString toString();\n"                                   \
+    "  QString toString() { return QString::fromUtf8(toByteArray()); }\n" \
+    "  QByteArray toByteArray();\n"                             \
+    "  int averageOutputSize() const { return averageSize.fetchAndAddRelaxed(0); }\n" \
+    "private:\n"                                                \
+    "  static QAtomicInt averageSize;\n"                        \
     "};\n"                                                      \
     "\n"                                                        \
-    "QString %1::toString()\n"                                  \
+    "QAtomicInt %1::averageSize(0);\n"                          \
+    "\n"                                                        \
+    "QByteArray %1::toByteArray()\n"                            \
     "{\n"                                                       \
-    "  responsebody.reserve(%3);\n"                             \
+    "  responsebody.reserve(qMax(averageOutputSize(), %3));\n"  \
     "%2\n"                                                      \
+    "  updateAverageOutputSize(averageSize);\n"                 \
     "  return responsebody;\n"                                  \
     "}\n"                                                       \
     "\n"                                                        \
@@ -84,7 +91,7 @@ bool ErbConverter::convert(const QString &erbPath, int trimMode) const
     parser.parse(QTextStream(&erbFile).readAll());
     QString code = parser.sourceCode();
     QTextStream ts(&outFile);
-    ts << QString(VIEW_SOURCE_TEMPLATE).arg(className, code, QString::number(code.size()), generateIncludeCode(parser));
+    ts << QString(VIEW_SOURCE_TEMPLATE).arg(className, code, QString::number(parser.literalByteCount()), generateIncludeCode(parser));
     if (ts.status() == QTextStream::Ok) {
         printf("  created  %s\n", qPrintable(outFile.fileName()));
     }
@@ -104,7 +111,7 @@ bool ErbConverter::convert(const QString &className, const QString &erb) const
     parser.parse(erb);
     QString code = parser.sourceCode();
     QTextStream ts(&outFile);
-    ts << QString(VIEW_SOURCE_TEMPLATE).arg(className, code, QString::number(code.size()), generateIncludeCode(parser));
+    ts << QString(VIEW_SOURCE_TEMPLATE).arg(className, code, QString::number(parser.literalByteCount()), generateIncludeCode(parser));
     if (ts.status() == QTextStream::Ok) {
         printf("  created  %s\n", qPrintable(outFile.fileName()));
     }
@@ -122,6 +129,48 @@ QString ErbConverter::escapeNewline(const QString &string)
 }
 
 
+// Returns the contents of a C string literal which represents the data
+QString ErbConverter::escapeCString(const QByteArray &data)
+{
+    QString s;
+    s.reserve(data.length() + data.length() / 4);
+    char prev = 0;
+    for (int i = 0; i < data.length(); ++i) {
+        char c = data[i];
+        switch (c) {
+        case '\\':
+            s += QLatin1String("\\\\");
+            break;
+        case '"':
+            s += QLatin1String("\\\"");
+            break;
+        case '\n':
+            s += QLatin1String("\\n");
+            break;
+        case '\r':
+            s += QLatin1String("\\r");
+            break;
+        case '\t':
+            s += QLatin1String("\\t");
+            break;
+        case '?':
+            // Avoids trigraphs
+            s += (prev == '?') ? QLatin1String("\\?") : QLatin1String("?");
+            break;
+        default:
+            if ((uchar)c < 0x20 || (uchar)c >= 0x7f) {
+                s += QString().sprintf("\\%03o", (uchar)c);
+            } else {
+                s += QLatin1Char(c);
+            }
+            break;
+        }
+        prev = c;
+    }
+    return s;
+}
+
+
 QString ErbConverter::generateIncludeCode(const ErbParser &parser) const
 {
     QString code = parser.includeCode();
@@ -18,6 +18,7 @@ public:
     //static QString convertToSourceCode(const QString &className, const QString &erb);
     static QString fileSuffix() { return "erb"; }
     static QString escapeNewline(const QString &string);
+    static QString escapeCString(const QByteArray &data);
 
 protected:
     QString generateIncludeCode(const ErbParser &parser) const;
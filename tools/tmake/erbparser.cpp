@@ -5,9 +5,12 @@
  * the New BSD License, which is incorporated herein by reference.
  */
 
+#include <QRegExp>
 #include "erbparser.h"
 #include "erbconverter.h"
 
+#define LITERAL_MAX_LENGTH  8192
+
 
 static QString semicolonTrim(const QString &str)
 {
@@ -29,15 +32,25 @@ void ErbParser::parse(const QString &erb)
     srcCode.reserve(erb.length() * 2);
     erbData = erb;
     pos = 0;
+    braceDepth = 0;
+    cacheBlockDepths.clear();
+    literalSize = 0;
 
     while (pos < erbData.length()) {
         int i = erbData.indexOf("<%", pos);
         QString text = erbData.mid(pos, i - pos);
         if (!text.isEmpty()) {
-            // HTML output
-            srcCode += QLatin1String("  responsebody += tr(\"");
-            srcCode += ErbConverter::escapeNewline(text);
-            srcCode += QLatin1String("\");\n");
+            // HTML output, encoded in UTF-8 previously
+            QByteArray utf8 = text.toUtf8();
+            literalSize += utf8.length();
+            for (int j = 0; j < utf8.length(); j += LITERAL_MAX_LENGTH) {
+                QByteArray chunk = utf8.mid(j, LITERAL_MAX_LENGTH);
+                srcCode += QLatin1String("  echo(\"");
+                srcCode += ErbConverter::escapeCString(chunk);
+                srcCode += QLatin1String("\", ");
+                srcCode += QString::number(chunk.length());
+                srcCode += QLatin1String(");\n");
+            }
         } 
             
         if (i >= 0) {
@@ -126,38 +139,44 @@ void ErbParser::parsePercentTag()
             ++pos;
             // Outputs the value
             QPair<QString, QString> p = parseEndPercentTag();
-            if (p.second.isEmpty()) {
-                srcCode += QLatin1String("responsebody += QVariant(");
+            QString bytes = bytesExpression(semicolonTrim(p.first));
+            if (p.second.isEmpty() && !bytes.isEmpty()) {
+                // Splices the UTF-8 data of the sub-view
+                srcCode += QLatin1String("echo(");
+                srcCode += bytes;
+                srcCode += QLatin1String(");\n");
+            } else if (p.second.isEmpty()) {
+                srcCode += QLatin1String("echo(QVariant(");
                 srcCode += semicolonTrim(p.first);
-                srcCode += QLatin1String(").toString();\n");
+                srcCode += QLatin1String("));\n");
             } else {
                 srcCode += QLatin1String("{ QString ___s = QVariant(");
                 srcCode += semicolonTrim(p.first);
-                srcCode += QLatin1String(").toString(); responsebody += (___s.isEmpty()) ? QVariant(");
+                srcCode += QLatin1String(").toString(); if (___s.isEmpty()) echo(QVariant(");
                 srcCode += semicolonTrim(p.second);
-                srcCode += QLatin1String(").toString() : ___s; }\n");
+                srcCode += QLatin1String(")); else echo(___s); }\n");
             }
 
         } else {  // <%=
             // Outputs the escaped value
             QPair<QString, QString> p = parseEndPercentTag();
             if (p.second.isEmpty()) {
-                srcCode += QLatin1String("responsebody += THttpUtility::htmlEscape(");
+                srcCode += QLatin1String("echo(THttpUtility::htmlEscape(");
                 srcCode += semicolonTrim(p.first);
-                srcCode += QLatin1String(");\n");
+                srcCode += QLatin1String("));\n");
             } else {
                 srcCode += QLatin1String("{ QString ___s = QVariant(");
                 srcCode += semicolonTrim(p.first);
-                srcCode += QLatin1String(").toString(); responsebody += (___s.isEmpty()) ? THttpUtility::htmlEscape(");
+                srcCode += QLatin1String(").toString(); if (___s.isEmpty()) echo(THttpUtility::htmlEscape(");
                 srcCode += semicolonTrim(p.second);
-                srcCode += QLatin1String(") : THttpUtility::htmlEscape(___s); }\n");
+                srcCode += QLatin1String(")); else echo(THttpUtility::htmlEscape(___s)); }\n");
             }
         }
 
     } else {  // <% 
         --pos;
         QPair<QString, QString> p = parseEndPercentTag();
-        str = p.first.trimmed();
+        str = parseRawCode(p.first.trimmed());
         if (!str.endsWith(';')) {
             str += QLatin1Char(';');
         }
@@ -168,6 +187,92 @@ void ErbParser::parsePercentTag()
 }
 
 
+/*
+  Returns the expression which gives the UTF-8 data of the expression
+  \a expr, if it is a single call of yield() or renderPartial(), i.e.
+  yieldBytes() or renderPartialBytes() with the same arguments;
+  otherwise returns an empty string.
+ */
+QString ErbParser::bytesExpression(const QString &expr)
+{
+    QRegExp rx("^(yield|renderPartial)\\s*\\(");
+    if (rx.indexIn(expr) != 0 || !expr.endsWith(QLatin1Char(')'))) {
+        return QString();
+    }
+
+    // The parenthesis opened after the name must close at the end
+    int depth = 0;
+    QChar quote;
+    for (int i = rx.matchedLength() - 1; i < expr.length(); ++i) {
+        QChar c = expr[i];
+        if (!quote.isNull()) {
+            if (c == QLatin1Char('\\')) {
+                ++i;
+            } else if (c == quote) {
+                quote = QChar();
+            }
+        } else if (c == QLatin1Char('"') || c == QLatin1Char('\'')) {
+            quote = c;
+        } else if (c == QLatin1Char('(')) {
+            ++depth;
+        } else if (c == QLatin1Char(')')) {
+            if (--depth == 0 && i < expr.length() - 1) {
+                return QString();
+            }
+        }
+    }
+    if (depth != 0) {
+        return QString();
+    }
+    return rx.cap(1) + QLatin1String("Bytes") + expr.mid(rx.cap(1).length());
+}
+
+
+/*
+  Tracks the depth of braces in the raw code. A fragment cache block
+  'cache("key", lifeTime) {' is converted into a call of
+  beginFragmentCache(), and a call of endFragmentCache() is inserted
+  after the brace closing the block.
+ */
+QString ErbParser::parseRawCode(const QString &code)
+{
+    QRegExp rx("^cache\\s*\\((.*)\\)\\s*\\{$");
+    bool cacheBlock = rx.exactMatch(code);
+    QString src = (cacheBlock) ? QLatin1String("if (beginFragmentCache(") + rx.cap(1) + QLatin1String(")) {") : code;
+
+    QString res;
+    res.reserve(src.length());
+    QChar quote;
+    for (int i = 0; i < src.length(); ++i) {
+        QChar c = src[i];
+        res += c;
+
+        if (!quote.isNull()) {
+            if (c == QLatin1Char('\\') && i + 1 < src.length()) {
+                res += src[++i];
+            } else if (c == quote) {
+                quote = QChar();
+            }
+        } else if (c == QLatin1Char('\'') || c == QLatin1Char('"')) {
+            quote = c;
+        } else if (c == QLatin1Char('{')) {
+            ++braceDepth;
+        } else if (c == QLatin1Char('}')) {
+            if (!cacheBlockDepths.isEmpty() && cacheBlockDepths.last() == braceDepth) {
+                cacheBlockDepths.removeLast();
+                res += QLatin1String(" endFragmentCache();");
+            }
+            --braceDepth;
+        }
+    }
+
+    if (cacheBlock) {
+        cacheBlockDepths << braceDepth;
+    }
+    return res;
+}
+
+
 QPair<QString, QString> ErbParser::parseEndPercentTag()
 {
     QString string;
@@ -3,6 +3,7 @@
 
 #include <QString>
 #include <QPair>
+#include <QList>
 
 
 class ErbParser
@@ -14,10 +15,12 @@ public:
         StrongTrim,  // Removes whitespaces if the end is "%>"
     };
 
-    ErbParser(TrimMode mode) : trimMode(mode), pos(0) { }
+    ErbParser(TrimMode mode) : trimMode(mode), pos(0), braceDepth(0), literalSize(0) { }
     void parse(const QString &text);
     QString sourceCode() const { return srcCode; }
     QString includeCode() const { return incCode; }
+    int literalByteCount() const { return literalSize; }
+    static QString bytesExpression(const QString &expr);
 
 private:
     bool posMatchWith(const QString &str, int offset = 0) const;
@@ -25,6 +28,7 @@ private:
     QPair<QString, QString> parseEndPercentTag();
     void skipWhiteSpacesAndNewLineCode();
     QString parseQuote();
+    QString parseRawCode(const QString &code);
 
     TrimMode trimMode;
     QString erbData;
@@ -32,6 +36,9 @@ private:
     QString incCode;
     int pos;
     QString startTag;
+    int braceDepth;
+    int literalSize;
+    QList<int> cacheBlockDepths;
 };
 
 #endif // ERBPARSER_H
@@ -40,6 +40,10 @@ QString generateErbPhrase(const QString &str, int echoOption)
         switch (echoOption) {
         case OtmParser::NormalEcho:
             res += QLatin1String("echo(");
+            if (!ErbParser::bytesExpression(s.trimmed()).isEmpty()) {
+                // Splices the UTF-8 data of the sub-view
+                s = ErbParser::bytesExpression(s.trimmed());
+            }
             break;
             
         case OtmParser::EscapeEcho:
@@ -143,60 +143,82 @@ void TestTfpconverter::erbparse_data()
     QTest::addColumn<QString>("expe");
 
     QTest::newRow("1") << "<body>Hello ... \n</body>"
-                       << "  responsebody += tr(\"<body>Hello ... \\n</body>\");\n";
+                       << "  echo(\"<body>Hello ... \\n</body>\", 24);\n";
     QTest::newRow("2") << "<body>Hello <%# this is comment!! %></body>"
-                       << "  responsebody += tr(\"<body>Hello \");\n  /* this is comment!! */\n  responsebody += tr(\"</body>\");\n";
+                       << "  echo(\"<body>Hello \", 12);\n  /* this is comment!! */\n  echo(\"</body>\", 7);\n";
     QTest::newRow("3") << "<body>Hello <%# this is comment!! %>   \n</body>"
-                       << "  responsebody += tr(\"<body>Hello \");\n  /* this is comment!! */\n  responsebody += tr(\"</body>\");\n";
+                       << "  echo(\"<body>Hello \", 12);\n  /* this is comment!! */\n  echo(\"</body>\", 7);\n";
     
     QTest::newRow("4") << "<body>Hello <%# this is \"comment!!\" %></body>"
-                       << "  responsebody += tr(\"<body>Hello \");\n  /* this is \"comment!!\" */\n  responsebody += tr(\"</body>\");\n";
+                       << "  echo(\"<body>Hello \", 12);\n  /* this is \"comment!!\" */\n  echo(\"</body>\", 7);\n";
     QTest::newRow("5") << "<body>Hello <%# this is \"comment!!\" %>  \r\n</body>"
-                       << "  responsebody += tr(\"<body>Hello \");\n  /* this is \"comment!!\" */\n  responsebody += tr(\"</body>\");\n";
+                       << "  echo(\"<body>Hello \", 12);\n  /* this is \"comment!!\" */\n  echo(\"</body>\", 7);\n";
 
     QTest::newRow("6") << "<body>Hello <% int i; %></body>"
-                       << "  responsebody += tr(\"<body>Hello \");\n  int i;\n  responsebody += tr(\"</body>\");\n";
+                       << "  echo(\"<body>Hello \", 12);\n  int i;\n  echo(\"</body>\", 7);\n";
     QTest::newRow("7") << "<body>Hello <% QString s(\"%>\"); %></body>"
-                       << "  responsebody += tr(\"<body>Hello \");\n  QString s(\"%>\");\n  responsebody += tr(\"</body>\");\n";
+                       << "  echo(\"<body>Hello \", 12);\n  QString s(\"%>\");\n  echo(\"</body>\", 7);\n";
     QTest::newRow("8") << "<body>Hello <%== vvv %></body>"
-                       << "  responsebody += tr(\"<body>Hello \");\n  responsebody += QVariant(vvv).toString();\n  responsebody += tr(\"</body>\");\n";
+                       << "  echo(\"<body>Hello \", 12);\n  echo(QVariant(vvv));\n  echo(\"</body>\", 7);\n";
     QTest::newRow("9") << "<body>Hello <%= vvv %> \n</body>"
-                       << "  responsebody += tr(\"<body>Hello \");\n  responsebody += THttpUtility::htmlEscape(vvv);\n  responsebody += tr(\" \\n</body>\");\n";
+                       << "  echo(\"<body>Hello \", 12);\n  echo(THttpUtility::htmlEscape(vvv));\n  echo(\" \\n</body>\", 9);\n";
     QTest::newRow("10") << "<body>Hello <%= vvv; -%> \n</body>"
-                        << "  responsebody += tr(\"<body>Hello \");\n  responsebody += THttpUtility::htmlEscape(vvv);\n  responsebody += tr(\"</body>\");\n";
+                        << "  echo(\"<body>Hello \", 12);\n  echo(THttpUtility::htmlEscape(vvv));\n  echo(\"</body>\", 7);\n";
     QTest::newRow("11") << "<body>Hello <% int i; -%> \r\n </body>"
-                        << "  responsebody += tr(\"<body>Hello \");\n  int i;\n  responsebody += tr(\" </body>\");\n";
+                        << "  echo(\"<body>Hello \", 12);\n  int i;\n  echo(\" </body>\", 8);\n";
     QTest::newRow("12") << "<body>Hello <% int i; %> \r\n</body>"
-                        << "  responsebody += tr(\"<body>Hello \");\n  int i;\n  responsebody += tr(\"</body>\");\n";
+                        << "  echo(\"<body>Hello \", 12);\n  int i;\n  echo(\"</body>\", 7);\n";
     QTest::newRow("13") << "<body>Hello ... \r\n</body>"
-                        << "  responsebody += tr(\"<body>Hello ... \\r\\n</body>\");\n";
+                        << "  echo(\"<body>Hello ... \\r\\n</body>\", 25);\n";
     QTest::newRow("14") << "<body>Hello <%= vvv; +%> \n</body>"
-                        << "  responsebody += tr(\"<body>Hello \");\n  responsebody += THttpUtility::htmlEscape(vvv);\n  responsebody += tr(\" \\n</body>\");\n";
+                        << "  echo(\"<body>Hello \", 12);\n  echo(THttpUtility::htmlEscape(vvv));\n  echo(\" \\n</body>\", 9);\n";
     QTest::newRow("15") << "<body>Hello <%= vvv; +%></body>\r\n"
-                        << "  responsebody += tr(\"<body>Hello \");\n  responsebody += THttpUtility::htmlEscape(vvv);\n  responsebody += tr(\"</body>\\r\\n\");\n";
+                        << "  echo(\"<body>Hello \", 12);\n  echo(THttpUtility::htmlEscape(vvv));\n  echo(\"</body>\\r\\n\", 9);\n";
     QTest::newRow("16") << "<body>Hello <% int i; +%> \r\n </body>"
-                        << "  responsebody += tr(\"<body>Hello \");\n  int i;\n  responsebody += tr(\" \\r\\n </body>\");\n";
+                        << "  echo(\"<body>Hello \", 12);\n  int i;\n  echo(\" \\r\\n </body>\", 11);\n";
 
     /** echo export object **/
     QTest::newRow("20") << "<body>Hello <%=$ hoge -%> \r\n </body>"
-                        << "  responsebody += tr(\"<body>Hello \");\n  tehex(hoge);\n  responsebody += tr(\" </body>\");\n";
+                        << "  echo(\"<body>Hello \", 12);\n  tehex(hoge);\n  echo(\" </body>\", 8);\n";
     QTest::newRow("21") << "<body>Hello <%==$ hoge %> \r\n </body>"
-                        << "  responsebody += tr(\"<body>Hello \");\n  techoex(hoge);\n  responsebody += tr(\" \\r\\n </body>\");\n";
+                        << "  echo(\"<body>Hello \", 12);\n  techoex(hoge);\n  echo(\" \\r\\n </body>\", 11);\n";
 
     /** Echo a default value on ERB **/
     QTest::newRow("16") << "<body><%# comment. %|% 33 %></body>"
-                        << "  responsebody += tr(\"<body>\");\n  /* comment. */\n  responsebody += tr(\"</body>\");\n";
+                        << "  echo(\"<body>\", 6);\n  /* comment. */\n  echo(\"</body>\", 7);\n";
     QTest::newRow("17") << "<body><%= number %|% 33 %></body>"
-                        << "  responsebody += tr(\"<body>\");\n  { QString ___s = QVariant(number).toString(); responsebody += (___s.isEmpty()) ? THttpUtility::htmlEscape(33) : THttpUtility::htmlEscape(___s); }\n  responsebody += tr(\"</body>\");\n";
+                        << "  echo(\"<body>\", 6);\n  { QString ___s = QVariant(number).toString(); if (___s.isEmpty()) echo(THttpUtility::htmlEscape(33)); else echo(THttpUtility::htmlEscape(___s)); }\n  echo(\"</body>\", 7);\n";
     QTest::newRow("18") << "<body><%== number %|% 33 %></body>"
-                        << "  responsebody += tr(\"<body>\");\n  { QString ___s = QVariant(number).toString(); responsebody += (___s.isEmpty()) ? QVariant(33).toString() : ___s; }\n  responsebody += tr(\"</body>\");\n";
+                        << "  echo(\"<body>\", 6);\n  { QString ___s = QVariant(number).toString(); if (___s.isEmpty()) echo(QVariant(33)); else echo(___s); }\n  echo(\"</body>\", 7);\n";
     QTest::newRow("19") << "<body><%=$number %|% 33 %></body>"
-                        << "  responsebody += tr(\"<body>\");\n  tehex2(number, (33));\n  responsebody += tr(\"</body>\");\n";
+                        << "  echo(\"<body>\", 6);\n  tehex2(number, (33));\n  echo(\"</body>\", 7);\n";
     // Irregular pattern
     QTest::newRow("20") << "<body><%==$number %|% 33 -%>\t\n</body>"
-                        << "  responsebody += tr(\"<body>\");\n  techoex2(number, (33));\n  responsebody += tr(\"</body>\");\n";
+                        << "  echo(\"<body>\", 6);\n  techoex2(number, (33));\n  echo(\"</body>\", 7);\n";
     QTest::newRow("21") << "<body><%== \"  %|%\" %|% \"%|%\" -%> \t \n</body>"
-                        << "  responsebody += tr(\"<body>\");\n  { QString ___s = QVariant(\"  %|%\").toString(); responsebody += (___s.isEmpty()) ? QVariant(\"%|%\").toString() : ___s; }\n  responsebody += tr(\"</body>\");\n";
+                        << "  echo(\"<body>\", 6);\n  { QString ___s = QVariant(\"  %|%\").toString(); if (___s.isEmpty()) echo(QVariant(\"%|%\")); else echo(___s); }\n  echo(\"</body>\", 7);\n";
+
+    /** Sub-view data without conversion **/
+    QTest::newRow("23") << "<div><%== yield() %></div>"
+                        << "  echo(\"<div>\", 5);\n  echo(yieldBytes());\n  echo(\"</div>\", 6);\n";
+    QTest::newRow("24") << "<%== renderPartial(\"nav\", vars); %>"
+                        << "  echo(renderPartialBytes(\"nav\", vars));\n";
+    QTest::newRow("25") << "<%== renderPartial(\")\") + x %>"
+                        << "  echo(QVariant(renderPartial(\")\") + x));\n";
+    QTest::newRow("26") << "<%== yield().left(10) %>"
+                        << "  echo(QVariant(yield().left(10)));\n";
+
+    /** UTF-8 literal **/
+    QTest::newRow("22") << QString::fromUtf8("<p>\xc3\xa9\"??\"</p>")
+                        << "  echo(\"<p>\\303\\251\\\"?\\?\\\"</p>\", 13);\n";
+
+    /** Fragment cache **/
+    QTest::newRow("30") << "<% cache(\"nav\", 60) { %><p>x</p><% } %>"
+                        << "  if (beginFragmentCache(\"nav\", 60)) {;\n  echo(\"<p>x</p>\", 8);\n  } endFragmentCache();\n";
+    QTest::newRow("31") << "<% cache(\"a\") { %><% if (x) { %>y<% } %><% } %>"
+                        << "  if (beginFragmentCache(\"a\")) {;\n  if (x) {;\n  echo(\"y\", 1);\n  };\n  } endFragmentCache();\n";
+    QTest::newRow("32") << "<% if (x) { %><% cache(\"}\") { %>y<% } } %>"
+                        << "  if (x) {;\n  if (beginFragmentCache(\"}\")) {;\n  echo(\"y\", 1);\n  } endFragmentCache(); };\n";
 }
 
 
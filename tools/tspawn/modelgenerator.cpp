@@ -47,6 +47,7 @@
     "\n"                                                 \
     "class TSqlObject;\n"                                \
     "class %2Object;\n"                                  \
+    "%7"                                                 \
     "\n\n"                                               \
     "class T_MODEL_EXPORT %2 : public TAbstractModel\n"  \
     "{\n"                                                \
@@ -57,6 +58,7 @@
     "    ~%2();\n"                                       \
     "\n"                                                 \
     "%3"                                                 \
+    "%8"                                                 \
     "    %2 &operator=(const %2 &other);\n"              \
     "\n"                                                 \
     "    static %2 create(%4);\n"                        \
@@ -81,6 +83,7 @@
     "#include <TreeFrogModel>\n"                              \
     "#include \"%1.h\"\n"                                     \
     "#include \"%1object.h\"\n"                               \
+    "%10"                                                     \
     "\n"                                                      \
     "%2::%2()\n"                                              \
     "    : TAbstractModel(), d(new %2Object)\n"               \
@@ -101,6 +104,7 @@
     "}\n"                                                     \
     "\n"                                                      \
     "%4"                                                      \
+    "%11"                                                     \
     "%2 &%2::operator=(const %2 &other)\n"                    \
     "{\n"                                                     \
     "    d = other.d;  // increments the reference count of the data\n" \
@@ -396,6 +400,10 @@ QStringList ModelGenerator::genModel() const
     QStringList ret;
 
     QPair<QStringList, QStringList> p = createModelParams();
+    QPair<QStringList, QStringList> assoc = createAssociationParams();
+    p.first << assoc.first;
+    p.second << assoc.second;
+
     QString fileName = dstDir.filePath(modelName.toLower() + ".h");
     gen(fileName, MODEL_HEADER_FILE_TEMPLATE, p.first);
     ret << QFileInfo(fileName).fileName();
@@ -545,6 +553,111 @@ QPair<QStringList, QStringList> ModelGenerator::createModelParams() const
 }
 
 
+static bool hasField(const TableSchema &schema, const QString &fieldName)
+{
+    QList<QPair<QString, QString> > fieldList = schema.getFieldList();
+    for (QListIterator<QPair<QString, QString> > it(fieldList); it.hasNext(); ) {
+        if (it.next().first.toLower() == fieldName)
+            return true;
+    }
+    return false;
+}
+
+/*
+  Returns true if the model \a related and its ORM object class have
+  been generated in the directory \a dir.
+*/
+static bool modelExists(const QDir &dir, const QString &related)
+{
+    return dir.exists(related.toLower() + ".h") && dir.exists("sqlobjects/" + related.toLower() + "object.h");
+}
+
+/*
+  Creates the accessors of the associations found by the naming
+  convention of foreign keys: a field 'blog_id' of this table refers to
+  the table 'blog' (belongs-to), and a field named after this table in
+  another table refers to this table (has-many). Only the models
+  generated already are associated. The accessors take the mapper which
+  retrieved the object, so that the associations included by
+  includeBelongsTo() or includeHasMany() are not queried again:
+    TSqlORMapper<BlogObject> mapper;
+    mapper.includeHasMany<CommentObject>(CommentObject::BlogId);
+    mapper.find();
+    for (int i = 0; i < mapper.rowCount(); ++i) {
+        QList<Comment> comments = Blog(mapper.value(i)).commentList(mapper);
+    }
+*/
+QPair<QStringList, QStringList> ModelGenerator::createAssociationParams() const
+{
+    QString fwdDecl;
+    QString assocDecl;
+    QString includes;
+    QString assocImpl;
+    TableSchema ts(tableName);
+    QStringList tables = TableSchema::tables();
+    QList<QPair<QString, QString> > fieldList = ts.getFieldList();
+    QString pkName = ts.primaryKeyFieldName();
+
+    // Belongs-to
+    for (QListIterator<QPair<QString, QString> > it(fieldList); it.hasNext(); ) {
+        const QPair<QString, QString> &p = it.next();
+        if (!p.first.endsWith("_id", Qt::CaseInsensitive) || p.first == pkName) {
+            continue;
+        }
+
+        QString table = p.first.left(p.first.length() - 3).toLower();
+        QString related = fieldNameToEnumName(table);
+        if (table == tableName || !tables.contains(table) || !modelExists(dstDir, related)) {
+            continue;
+        }
+
+        fwdDecl += QString("class %1;\n").arg(related);
+        assocDecl += QString("    %1 %2(const TSqlORMapper<%3Object> &mapper) const;\n").arg(related, fieldNameToVariableName(table), modelName);
+        includes += QString("#include \"%1.h\"\n#include \"%1object.h\"\n").arg(related.toLower());
+        assocImpl += QString("%1 %2::%3(const TSqlORMapper<%2Object> &mapper) const\n"
+                             "{\n"
+                             "    return %1(mapper.belongsTo<%1Object>(*d, %2Object::%4));\n"
+                             "}\n\n").arg(related, modelName, fieldNameToVariableName(table), fieldNameToEnumName(p.first));
+    }
+
+    // Has-many
+    QString fkName = tableName.toLower() + "_id";
+    if (!pkName.isEmpty()) {
+        for (QStringListIterator it(tables); it.hasNext(); ) {
+            QString table = it.next();
+            QString related = fieldNameToEnumName(table);
+            if (table == tableName || !modelExists(dstDir, related) || !hasField(TableSchema(table), fkName)) {
+                continue;
+            }
+
+            fwdDecl += QString("class %1;\n").arg(related);
+            assocDecl += QString("    QList<%1> %2List(const TSqlORMapper<%3Object> &mapper) const;\n").arg(related, fieldNameToVariableName(table), modelName);
+            includes += QString("#include \"%1.h\"\n#include \"%1object.h\"\n").arg(related.toLower());
+            assocImpl += QString("QList<%1> %2::%3List(const TSqlORMapper<%2Object> &mapper) const\n"
+                                 "{\n"
+                                 "    QList<%1> list;\n"
+                                 "    QList<%1Object> objects = mapper.hasMany<%1Object>(*d, %1Object::%4);\n"
+                                 "    for (QListIterator<%1Object> it(objects); it.hasNext(); ) {\n"
+                                 "        list << %1(it.next());\n"
+                                 "    }\n"
+                                 "    return list;\n"
+                                 "}\n\n").arg(related, modelName, fieldNameToVariableName(table), fieldNameToEnumName(fkName));
+        }
+    }
+
+    if (!assocDecl.isEmpty()) {
+        assocDecl.prepend('\n');
+        fwdDecl.prepend("template <class T> class TSqlORMapper;\n");
+    }
+
+    QStringList headerArgs;
+    headerArgs << fwdDecl << assocDecl;
+    QStringList implArgs;
+    implArgs << includes << assocImpl;
+    return QPair<QStringList, QStringList>(headerArgs, implArgs);
+}
+
+
 bool ModelGenerator::gen(const QString &fileName, const QString &format, const QStringList &args)
 {
     QString out = format;
@@ -25,6 +25,7 @@ protected:
     QStringList genModel() const;
     QStringList genUserModel(const QString &usernameField = "username", const QString &passwordField = "password") const;
     QPair<QStringList, QStringList> createModelParams() const;
+    QPair<QStringList, QStringList> createAssociationParams() const;
     static bool gen(const QString &fileName, const QString &format, const QStringList &args);
     static QString createParam(const QString &type, const QString &name);
 